@@ -0,0 +1,19 @@
+#!/bin/sh
+# Write an ATAG list telling the kernel about an initrd, for booting the ELF under qemu, which
+# only writes ATAGS itself for Linux images.  There is no MEM tag, so mem_init asks the firmware.
+# Usage: atags.sh <initrd address> <initrd file> <output>
+
+word() {
+    for shift in 0 8 16 24; do
+        printf "\\$(printf %03o $((($1 >> shift) & 255)))"
+    done
+}
+
+addr=$(($1))
+size=$(wc -c < "$2")
+
+{
+    word 2; word 0x54410001                             # CORE, empty
+    word 4; word 0x54420005; word $addr; word $size     # INITRD2, start and size
+    word 0; word 0                                      # NONE
+} > "$3"
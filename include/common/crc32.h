@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#define CRC32_INIT 0xFFFFFFFF
+
+// Standard CRC-32 (zlib, Ethernet).  Start from CRC32_INIT, feed the data through crc32_update
+// in as many pieces as you like, and finish with crc32_final
+uint32_t crc32_update(uint32_t crc, const void * data, uint32_t len);
+
+static inline uint32_t crc32_final(uint32_t crc) {
+    return crc ^ 0xFFFFFFFF;
+}
+
+// CRC of a single buffer
+uint32_t crc32(const void * data, uint32_t len);
+
+#endif
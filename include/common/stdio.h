@@ -1,14 +1,29 @@
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef STDIO_H
 #define STDIO_H
 
+// Where putc, puts and write send their output, any mix of these.  Input always comes from the UART
+#define STDIO_SINK_UART 0x1
+#define STDIO_SINK_FB   0x2
+
+void stdio_set_sinks(uint32_t sinks);
+uint32_t stdio_get_sinks(void);
+
 char getc(void);
 void putc(char c);
 
 void puts(const char * s);
+void write(const char * buf, size_t len);
 
 // This version of gets copies until newline, replacing newline with null char, or until buflen.
 // whichever comes first
 void gets(char * buf, int buflen);
 
+// gets that gives up after msecs milliseconds without a key press (0 waits forever).
+// Returns the line length, or -1 on timeout with whatever was typed left in buf
+int gets_timeout(char * buf, int buflen, uint32_t msecs);
+
 #endif
 
@@ -0,0 +1,46 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef STRING_H
+#define STRING_H
+
+/**
+ * String scanning, number parsing and number formatting.
+ *
+ * The scanning functions work a word at a time once the pointer is aligned, testing every byte of
+ * the word for a zero (or the wanted character) with a couple of ALU operations.  Aligned loads
+ * never cross into a page the string doesn't touch, so reading a little past the end is safe.
+ * memmove copies words too when source and destination are equally aligned.
+ *
+ * The parsers are checked: they return 0 and store the value, or -1 if there were no digits or
+ * the value doesn't fit, leaving *value alone.  end, if not NULL, gets the first character not
+ * parsed.  Leading spaces and a sign are skipped.  Base 0 picks it from the prefix: 0x for 16,
+ * 0b for 2, a leading 0 for 8, otherwise 10.  Base 16 also takes an optional 0x.
+ *
+ * The formatters write into the caller's buffer, so unlike itoa any number of them can be in
+ * use at once.  They return the length, not counting the terminating null.
+ */
+
+// Buffer sizes for the formatters, including the null
+#define UTOA_BUF_SIZE 11
+#define ITOA_BUF_SIZE 12
+#define UTOA64_BUF_SIZE 21
+#define ITOA64_BUF_SIZE 21
+
+size_t strlen(const char * s);
+int strcmp(const char * s1, const char * s2);
+void * memchr(const void * s, int c, size_t n);
+char * strchr(const char * s, int c);
+void * memmove(void * dest, const void * src, size_t n);
+
+int strtol32(const char * s, char ** end, int base, int32_t * value);
+int strtoul32(const char * s, char ** end, int base, uint32_t * value);
+int strtol64(const char * s, char ** end, int base, int64_t * value);
+int strtoul64(const char * s, char ** end, int base, uint64_t * value);
+
+int utoa_r(uint32_t value, char * buf);
+int itoa_r(int32_t value, char * buf);
+int utoa64_r(uint64_t value, char * buf);
+int itoa64_r(int64_t value, char * buf);
+
+#endif
@@ -35,4 +35,7 @@ typedef struct atag {
 
 uint32_t get_mem_size(atag_t * atags);
 
+// Returns the INITRD2 tag, or NULL if the bootloader didn't load an initrd
+initrd2_t * get_initrd(atag_t * atags);
+
 #endif
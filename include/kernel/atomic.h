@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <kernel/cpu.h>
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+/**
+ * Atomic operations on 32 bit words, built from exclusive loads and stores (LDREX/STREX, LDXR/STXR
+ * on AArch64).  Everything that returns a value is fully ordered: there is a barrier on both sides.
+ * The model 1 has no DMB instruction and uses the equivalent CP15 operation.
+ *
+ * Exclusives need the data cache on.  On the Pi 2 and 3 there is no global monitor for
+ * non-cacheable memory, so a STREX there can fail forever (QEMU doesn't model this).  mmu_init
+ * turns the cache on in the 32 bit kernels; before that, and in the 64 bit kernel where the MMU
+ * stays off, the operations below are a plain read-modify-write with IRQs masked instead.  That
+ * is only atomic because just core 0 runs: the other cores stay parked in boot.S, so nothing here
+ * has been tried with two cores at once.
+ */
+
+static inline void dmb(void)
+{
+#if defined(__aarch64__)
+    asm volatile("dmb ish" ::: "memory");
+#elif defined(MODEL_1)
+    asm volatile("mcr p15, 0, %0, c7, c10, 5" :: "r"(0) : "memory");
+#else
+    asm volatile("dmb ish" ::: "memory");
+#endif
+}
+
+static inline void dsb(void)
+{
+#if defined(__aarch64__)
+    asm volatile("dsb ish" ::: "memory");
+#elif defined(MODEL_1)
+    asm volatile("mcr p15, 0, %0, c7, c10, 4" :: "r"(0) : "memory");
+#else
+    asm volatile("dsb ish" ::: "memory");
+#endif
+}
+
+// Refetch everything after this, so it sees system register changes made before it
+static inline void isb(void)
+{
+#if defined(__aarch64__)
+    asm volatile("isb" ::: "memory");
+#elif defined(MODEL_1)
+    asm volatile("mcr p15, 0, %0, c7, c5, 4" :: "r"(0) : "memory");
+#else
+    asm volatile("isb" ::: "memory");
+#endif
+}
+
+// Wait for an event (another core's sev) and signal one
+static inline void wfe(void)
+{
+    asm volatile("wfe" ::: "memory");
+}
+
+static inline void sev(void)
+{
+    asm volatile("sev" ::: "memory");
+}
+
+// 1 once the data cache is on and LDREX/STREX can be trusted.  Kernel mode only
+static inline int atomic_exclusives_ok(void)
+{
+#ifdef __aarch64__
+    uint64_t sctlr;
+    asm volatile("mrs %0, sctlr_el1" : "=r"(sctlr));
+#else
+    uint32_t sctlr;
+    asm volatile("mrc p15, 0, %0, c1, c0, 0" : "=r"(sctlr));
+#endif
+    return (sctlr >> 2) & 1;        // SCTLR.C
+}
+
+// Load with acquire semantics: later accesses can't move before it
+static inline uint32_t atomic_load(const volatile uint32_t * ptr)
+{
+    uint32_t value = *ptr;
+    dmb();
+    return value;
+}
+
+// Store with release semantics: earlier accesses can't move after it
+static inline void atomic_store(volatile uint32_t * ptr, uint32_t value)
+{
+    dmb();
+    *ptr = value;
+}
+
+// Set *ptr to new if it is old.  Returns what *ptr was, so the swap happened if that equals old
+static inline uint32_t atomic_cas(volatile uint32_t * ptr, uint32_t old, uint32_t new)
+{
+    uint32_t prev, failed;
+    uintptr_t flags;
+
+    dmb();
+    if (!atomic_exclusives_ok()) {
+        flags = irq_save();
+        prev = *ptr;
+        if (prev == old)
+            *ptr = new;
+        irq_restore(flags);
+        dmb();
+        return prev;
+    }
+    do {
+#ifdef __aarch64__
+        asm volatile(
+            "   ldxr %w0, [%2]\n"
+            "   mov %w1, #0\n"
+            "   cmp %w0, %w3\n"
+            "   b.ne 1f\n"
+            "   stxr %w1, %w4, [%2]\n"
+            "1:\n"
+            : "=&r"(prev), "=&r"(failed)
+            : "r"(ptr), "r"(old), "r"(new)
+            : "cc", "memory");
+#else
+        asm volatile(
+            "   ldrex %0, [%2]\n"
+            "   mov %1, #0\n"
+            "   teq %0, %3\n"
+            "   strexeq %1, %4, [%2]\n"
+            : "=&r"(prev), "=&r"(failed)
+            : "r"(ptr), "r"(old), "r"(new)
+            : "cc", "memory");
+#endif
+    } while (failed);
+    dmb();
+
+    return prev;
+}
+
+// Add to *ptr.  Returns the value before the add
+static inline uint32_t atomic_fetch_add(volatile uint32_t * ptr, uint32_t value)
+{
+    uint32_t prev, next, failed;
+    uintptr_t flags;
+
+    dmb();
+    if (!atomic_exclusives_ok()) {
+        flags = irq_save();
+        prev = *ptr;
+        *ptr = prev + value;
+        irq_restore(flags);
+        dmb();
+        return prev;
+    }
+    do {
+#ifdef __aarch64__
+        asm volatile(
+            "   ldxr %w0, [%3]\n"
+            "   add %w1, %w0, %w4\n"
+            "   stxr %w2, %w1, [%3]\n"
+            : "=&r"(prev), "=&r"(next), "=&r"(failed)
+            : "r"(ptr), "r"(value)
+            : "memory");
+#else
+        asm volatile(
+            "   ldrex %0, [%3]\n"
+            "   add %1, %0, %4\n"
+            "   strex %2, %1, [%3]\n"
+            : "=&r"(prev), "=&r"(next), "=&r"(failed)
+            : "r"(ptr), "r"(value)
+            : "memory");
+#endif
+    } while (failed);
+    dmb();
+
+    return prev;
+}
+
+static inline uint32_t atomic_add_return(volatile uint32_t * ptr, uint32_t value)
+{
+    return atomic_fetch_add(ptr, value) + value;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <kernel/emmc.h>
+#include <kernel/mem.h>
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+// The cache keeps whole pages of the card, so one buffer covers 8 card blocks
+#define BCACHE_BUFFER_SIZE PAGE_SIZE
+#define BCACHE_BLOCKS_PER_BUFFER (BCACHE_BUFFER_SIZE / EMMC_BLOCK_SIZE)
+#define BCACHE_NUM_BUFFERS 64
+#define BCACHE_HASH_SIZE 128        // Must be a power of two
+// How many buffers past a sequential access to read ahead
+#define BCACHE_READAHEAD 4
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readaheads;        // Buffers fetched before anyone asked for them
+    uint32_t readahead_hits;    // Read ahead buffers that were later used
+    uint32_t writebacks;        // Dirty buffers written to the card
+} bcache_stats_t;
+
+// Initialize the card and allocate the cache buffers.  Returns 0 on success, -1 if there is no card
+int bcache_init(void);
+int bcache_ready(void);
+
+// Read or write count card blocks starting at lba through the cache.  Returns 0 on success, -1 on error
+int bcache_read(uint32_t lba, uint32_t count, void * buf);
+int bcache_write(uint32_t lba, uint32_t count, const void * buf);
+
+// Write every dirty buffer back to the card
+int bcache_sync(void);
+// Sync, then drop everything so the next access goes to the card
+int bcache_invalidate(void);
+
+void bcache_get_stats(bcache_stats_t * stats);
+void bcache_reset_stats(void);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Run every benchmark, reporting which architecture they ran on
+void bench_all(void);
+
+// Transmit throughput in bytes/sec at each supported baud rate, byte at a time vs FIFO bursts
+void bench_uart(void);
+
+// SD card read throughput in MB/s, straight from the card and through the block cache
+void bench_sd(void);
+
+// Timer wheel cost: add and cancel cycles, and the tick interrupt's cycles with and without
+// tens of thousands of timers pending
+void bench_timers(void);
+
+// Cycles per system call round trip from a user task, fast path vs slow path vs the vdso page
+void bench_syscalls(void);
+
+// Calls/sec of string.c's scanning, parsing and formatting against the byte at a time versions
+void bench_strings(void);
+
+// Cycles a caller spends on printk, against writing the same line straight to the UART
+void bench_log(void);
+
+// Characters/sec written to the UART and to the framebuffer console, scrolling by virtual
+// offset and by memmove
+void bench_console(void);
+
+// Cycles per load across 4 MB mapped with 4 KB pages, 64 KB large pages and 1 MB sections, in
+// page order and in random order, and the cost of a vmalloc's first touches
+void bench_tlb(void);
+
+#endif
@@ -0,0 +1,43 @@
+#include <stdint.h>
+
+#ifndef CHAINLOAD_H
+#define CHAINLOAD_H
+
+/**
+ * Receive a kernel image or a data blob over the UART from tools/chainload.py.
+ *
+ * Everything is little endian.  The kernel announces itself with "RCL1", then:
+ *   host:   header "RCLH", u32 size, u32 load address, u32 entry (CHAINLOAD_NO_ENTRY for a blob),
+ *           u32 baud (0 to keep the current one), u32 CRC32 of the image, u32 CRC32 of the header so far
+ *   kernel: "RCLA", u32 status.  CHAINLOAD_BAD_BAUD if the UART clock can't reach the rate, and the host
+ *           can start over at the current one
+ *   If a new baud rate was accepted both ends switch, the host sends "RCLS" until the kernel answers "RCLS".
+ *   If that fails both go back to the old rate and the kernel sends "RCLD" with CHAINLOAD_BAD_BAUD.
+ *   host:   data frames: 0x01, u16 sequence, u16 length, payload, u32 CRC32 of sequence..payload
+ *   kernel: 0x06 u16 sequence for each frame it accepts, or 0x15 u16 expected sequence to ask for a resend.
+ *           The host keeps up to CHAINLOAD_WINDOW frames unacknowledged and goes back to the NAKed one
+ *   kernel: "RCLD", u32 status once the whole image is in and its CRC checked
+ *
+ * A kernel image is then copied to its load address and started.  A blob is copied to its load address,
+ * which must be free memory, and stays there.
+ */
+
+#define CHAINLOAD_FRAME_SIZE 1024   // Payload bytes per frame, divides PAGE_SIZE
+#define CHAINLOAD_WINDOW 8
+#define CHAINLOAD_NO_ENTRY 0xFFFFFFFF
+
+typedef enum {
+    CHAINLOAD_OK = 0,
+    CHAINLOAD_BAD_HEADER,
+    CHAINLOAD_TOO_BIG,
+    CHAINLOAD_BAD_ADDRESS,
+    CHAINLOAD_BAD_BAUD,
+    CHAINLOAD_NO_MEMORY,
+    CHAINLOAD_BAD_CRC,
+    CHAINLOAD_TIMEOUT,
+} chainload_status_t;
+
+// Run one transfer.  Only returns if it failed, or if it received a blob
+chainload_status_t chainload(void);
+
+#endif
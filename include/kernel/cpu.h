@@ -0,0 +1,142 @@
+#include <stdint.h>
+
+#ifndef CPU_H
+#define CPU_H
+
+#define NUM_CPUS 4
+
+// Registers a task keeps across cpu_switch: the callee saved ones, the stack pointer and the
+// return address
+typedef struct {
+#ifdef __aarch64__
+    uint64_t x19_x29[11];
+    uint64_t lr;
+    uint64_t sp;
+#else
+    uint32_t r4_r11[8];
+    uint32_t sp;
+    uint32_t lr;
+#endif
+} cpu_context_t;
+
+// User registers saved on the kernel stack by a slow system call (vectors.S)
+typedef struct {
+#ifdef __aarch64__
+    uint64_t x[31];
+    uint64_t sp;            // SP_EL0
+    uint64_t pc;            // ELR_EL1
+    uint64_t pstate;        // SPSR_EL1
+#else
+    uint32_t r[13];
+    uint32_t sp;            // sp_usr
+    uint32_t lr;            // lr_usr
+    uint32_t pad;           // Keeps the frame a multiple of 8 bytes
+    uint32_t pc;
+    uint32_t cpsr;
+#endif
+} trap_frame_t;
+
+// Saved program status for a fresh user task: user mode, interrupts on
+#ifdef __aarch64__
+#define CPU_USER_PSTATE 0x0         // EL0t
+#else
+#define CPU_USER_PSTATE 0x10        // USR, ARM state
+#endif
+
+// Save the current context in from and continue from to
+void cpu_switch(cpu_context_t * from, cpu_context_t * to);
+
+// Return to user mode through the trap frame at the stack pointer.  A fresh task's context
+// starts here
+void cpu_enter_user(void);
+
+// Turn on the cycle counter.  Called once per core at boot
+void cpu_cycles_init(void);
+
+// Point this core's exceptions at the kernel's vectors (vectors.S)
+void cpu_vectors_init(void);
+
+// Which core we are running on
+static inline uint32_t cpu_id(void)
+{
+#if defined(__aarch64__)
+    uint64_t mpidr;
+    asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return mpidr & 3;
+#elif defined(MODEL_1)
+    return 0;
+#else
+    uint32_t mpidr;
+    asm volatile("mrc p15, 0, %0, c0, c0, 5" : "=r"(mpidr));
+    return mpidr & 3;
+#endif
+}
+
+// CPU cycles since cpu_cycles_init, low 32 bits
+static inline uint32_t cpu_cycles(void)
+{
+#if defined(__aarch64__)
+    uint64_t cycles;
+    asm volatile("mrs %0, pmccntr_el0" : "=r"(cycles));
+    return cycles;
+#elif defined(MODEL_1)
+    uint32_t cycles;
+    asm volatile("mrc p15, 0, %0, c15, c12, 1" : "=r"(cycles));
+    return cycles;
+#else
+    uint32_t cycles;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(cycles));
+    return cycles;
+#endif
+}
+
+static inline void irq_enable(void)
+{
+#ifdef __aarch64__
+    asm volatile("msr daifclr, #2" ::: "memory");
+#else
+    asm volatile("cpsie i" ::: "memory");
+#endif
+}
+
+static inline void irq_disable(void)
+{
+#ifdef __aarch64__
+    asm volatile("msr daifset, #2" ::: "memory");
+#else
+    asm volatile("cpsid i" ::: "memory");
+#endif
+}
+
+// Sleep until an interrupt is pending
+static inline void wfi(void)
+{
+#if defined(MODEL_1)
+    asm volatile("mcr p15, 0, %0, c7, c0, 4" :: "r"(0) : "memory");
+#else
+    asm volatile("wfi" ::: "memory");
+#endif
+}
+
+// Mask IRQs on this core, returning the previous mask state for irq_restore
+static inline uintptr_t irq_save(void)
+{
+    uintptr_t flags;
+#ifdef __aarch64__
+    asm volatile("mrs %0, daif\n msr daifset, #2" : "=r"(flags) :: "memory");
+#else
+    asm volatile("mrs %0, cpsr\n cpsid i" : "=r"(flags) :: "memory");
+#endif
+    return flags;
+}
+
+static inline void irq_restore(uintptr_t flags)
+{
+#ifdef __aarch64__
+    asm volatile("msr daif, %0" :: "r"(flags) : "memory");
+#else
+    asm volatile("msr cpsr_c, %0" :: "r"(flags) : "memory");
+#endif
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <kernel/peripheral.h>
+
+#ifndef EMMC_H
+#define EMMC_H
+
+// The BCM2835 EMMC controller is an Arasan SDHCI host wired to the SD card slot
+#define EMMC_BASE (PERIPHERAL_BASE + 0x300000)
+
+enum {
+    EMMC_ARG2        = (EMMC_BASE + 0x00),
+    EMMC_BLKSIZECNT  = (EMMC_BASE + 0x04),
+    EMMC_ARG1        = (EMMC_BASE + 0x08),
+    EMMC_CMDTM       = (EMMC_BASE + 0x0C),
+    EMMC_RESP0       = (EMMC_BASE + 0x10),
+    EMMC_RESP1       = (EMMC_BASE + 0x14),
+    EMMC_RESP2       = (EMMC_BASE + 0x18),
+    EMMC_RESP3       = (EMMC_BASE + 0x1C),
+    EMMC_DATA        = (EMMC_BASE + 0x20),
+    EMMC_STATUS      = (EMMC_BASE + 0x24),
+    EMMC_CONTROL0    = (EMMC_BASE + 0x28),
+    EMMC_CONTROL1    = (EMMC_BASE + 0x2C),
+    EMMC_INTERRUPT   = (EMMC_BASE + 0x30),
+    EMMC_IRPT_MASK   = (EMMC_BASE + 0x34),
+    EMMC_IRPT_EN     = (EMMC_BASE + 0x38),
+    EMMC_CONTROL2    = (EMMC_BASE + 0x3C),
+    EMMC_SLOTISR_VER = (EMMC_BASE + 0xFC),
+};
+
+// The size of a block on the card, and of a single data transfer unit
+#define EMMC_BLOCK_SIZE 512
+
+// The most blocks a single multi block command may move (BLKSIZECNT has a 16 bit count)
+#define EMMC_MAX_BLOCKS 0xFFFF
+
+// Find and initialize the card.  Returns 0 on success, -1 if there is no usable card
+int emmc_init(void);
+
+// Move count blocks starting at block lba.  Uses one multi block command for the whole range.
+// Returns 0 on success, -1 on error
+int emmc_read_blocks(uint32_t lba, uint32_t count, void * buf);
+int emmc_write_blocks(uint32_t lba, uint32_t count, const void * buf);
+
+#endif
@@ -0,0 +1,60 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef FBCON_H
+#define FBCON_H
+
+/**
+ * A text console on the framebuffer.
+ *
+ * Characters go into a grid of cells; the pixels are only drawn when the console is flushed,
+ * at the end of every write and before every scroll, and then only the rectangle of cells that
+ * changed since the last flush.  Drawing a cell copies its glyph from a cache baked at init,
+ * already expanded to pixels in the console colours, a row of words at a time.  Font rows are
+ * drawn twice, so cells are 8x16.
+ *
+ * Scrolling moves the screen's virtual offset a line down the double height buffer, so the GPU
+ * does it.  Only when the offset reaches the end of the buffer are the visible lines moved back
+ * to the top, one memmove every screenful.  FBCON_SCROLL_MEMMOVE moves the whole screen up a line
+ * on every scroll instead, which is also what happens if the firmware has no virtual offset.
+ */
+
+#define FBCON_WIDTH 1024
+#define FBCON_HEIGHT 768
+#define FBCON_SCALE 2               // Times each font row is drawn
+#define FBCON_CELL_WIDTH 8
+#define FBCON_CELL_HEIGHT 16
+#define FBCON_COLS (FBCON_WIDTH / FBCON_CELL_WIDTH)
+#define FBCON_ROWS (FBCON_HEIGHT / FBCON_CELL_HEIGHT)
+#define FBCON_TAB 8
+#define FBCON_FOREGROUND 0x00C0C0C0
+#define FBCON_BACKGROUND 0x00000000
+
+typedef enum {
+    FBCON_SCROLL_OFFSET,
+    FBCON_SCROLL_MEMMOVE,
+} fbcon_scroll_t;
+
+typedef struct {
+    uint32_t chars;             // Characters written
+    uint32_t cells_drawn;       // Glyphs copied to the screen
+    uint32_t flushes;
+    uint32_t scrolls;
+    uint32_t moves;             // Scrolls that had to move pixels
+} fbcon_stats_t;
+
+// Get a framebuffer and clear the screen.  Returns 0 on success, -1 if there is no display
+int fbcon_init(void);
+int fbcon_ready(void);
+
+void fbcon_putc(char c);
+void fbcon_puts(const char * s);
+void fbcon_write(const char * buf, size_t len);
+
+// Returns 0, or -1 if the firmware can't scroll by offset
+int fbcon_set_scroll(fbcon_scroll_t mode);
+fbcon_scroll_t fbcon_get_scroll(void);
+
+void fbcon_get_stats(fbcon_stats_t * stats);
+
+#endif
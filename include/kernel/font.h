@@ -0,0 +1,19 @@
+#include <stdint.h>
+
+#ifndef FONT_H
+#define FONT_H
+
+/**
+ * An 8x8 bitmap font for printable ASCII.  Each glyph is 8 rows of 8 bits, top row first, and
+ * bit 0 of a row is its leftmost pixel.
+ */
+
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 8
+#define FONT_FIRST ' '
+#define FONT_LAST '~'
+#define FONT_GLYPHS (FONT_LAST - FONT_FIRST + 1)
+
+extern const uint8_t font8x8[FONT_GLYPHS][FONT_HEIGHT];
+
+#endif
@@ -0,0 +1,31 @@
+#include <stdint.h>
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+/**
+ * A 32 bit framebuffer from the GPU, allocated through the mailbox property interface.
+ *
+ * The buffer is asked for twice as tall as the screen.  The screen shows the part of it starting
+ * at the virtual offset, so moving the offset scrolls without copying a pixel.  Firmware that
+ * won't do a taller buffer gives back virtual_height == height, and then only offset 0 works.
+ */
+
+#define FRAMEBUFFER_DEPTH 32
+
+typedef struct {
+    uint32_t * base;            // First pixel, 0x00RRGGBB
+    uint32_t width;             // Visible size in pixels
+    uint32_t height;
+    uint32_t virtual_height;    // Rows of pixels in the buffer
+    uint32_t pitch;             // Bytes from one row of pixels to the next
+    uint32_t size;              // Bytes in the buffer
+} framebuffer_t;
+
+// Ask the GPU for a width x height screen.  Returns 0 and fills in fb on success
+int framebuffer_init(framebuffer_t * fb, uint32_t width, uint32_t height);
+
+// Show the buffer from row y down.  Returns 0 on success, -1 if the firmware wouldn't
+int framebuffer_set_offset(uint32_t y);
+
+#endif
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <kernel/peripheral.h>
+
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+// The BCM2835 interrupt controller.  Models 2 and 3 route it to core 0 by default
+#define INTERRUPTS_BASE (PERIPHERAL_BASE + 0xB200)
+
+enum {
+    IRQ_BASIC_PENDING  = (INTERRUPTS_BASE + 0x00),
+    IRQ_PENDING_1      = (INTERRUPTS_BASE + 0x04),
+    IRQ_PENDING_2      = (INTERRUPTS_BASE + 0x08),
+    IRQ_FIQ_CONTROL    = (INTERRUPTS_BASE + 0x0C),
+    IRQ_ENABLE_1       = (INTERRUPTS_BASE + 0x10),
+    IRQ_ENABLE_2       = (INTERRUPTS_BASE + 0x14),
+    IRQ_ENABLE_BASIC   = (INTERRUPTS_BASE + 0x18),
+    IRQ_DISABLE_1      = (INTERRUPTS_BASE + 0x1C),
+    IRQ_DISABLE_2      = (INTERRUPTS_BASE + 0x20),
+    IRQ_DISABLE_BASIC  = (INTERRUPTS_BASE + 0x24),
+};
+
+// 0-31 are bank 1, 32-63 bank 2, and 64-71 the ARM side "basic" interrupts
+typedef enum {
+    IRQ_SYSTEM_TIMER_1 = 1,
+    IRQ_SYSTEM_TIMER_3 = 3,
+    IRQ_USB = 9,
+    IRQ_AUX = 29,
+    IRQ_UART = 57,
+    IRQ_ARM_TIMER = 64,
+} irq_number_t;
+
+#define NUM_IRQS 72
+
+// Exceptions other than IRQs, as passed to exception_panic
+typedef enum {
+    EXCEPTION_RESET = 0,
+    EXCEPTION_UNDEFINED,
+    EXCEPTION_SVC,
+    EXCEPTION_PREFETCH_ABORT,
+    EXCEPTION_DATA_ABORT,
+    EXCEPTION_FIQ,
+    EXCEPTION_SERROR,
+    EXCEPTION_SYNC,         // AArch64 lumps aborts and undefined instructions together, see the syndrome
+} exception_type_t;
+
+// The clearer acknowledges the interrupt at the device, then the handler does the work.
+// Both run in interrupt context with interrupts masked
+typedef void (*interrupt_handler_f)(void);
+typedef void (*interrupt_clearer_f)(void);
+
+// Install the exception vectors and unmask IRQs on this core
+void interrupts_init(void);
+
+// Route an interrupt to handler and enable it at the controller
+void register_irq_handler(irq_number_t irq, interrupt_handler_f handler, interrupt_clearer_f clearer);
+void unregister_irq_handler(irq_number_t irq);
+
+// Interrupts taken since boot
+uint32_t interrupts_count(void);
+
+// Called from the IRQ vector
+void irq_handler(void);
+
+// Called from the vectors for everything else.  Prints what happened, then kills the task if it
+// came from user mode, otherwise halts.  The syndrome is the SPSR on arm and the ESR on AArch64
+void exception_panic(uint32_t type, uintptr_t addr, uintptr_t syndrome, uint32_t from_user);
+
+// Called from the arm data abort vector with the faulting instruction and its SPSR.  Returns if
+// vm_fault mapped the address in, so the access can be retried
+void data_abort_handler(uintptr_t addr, uintptr_t spsr);
+
+#endif
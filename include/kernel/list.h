@@ -30,6 +30,9 @@
  *
  * struct nodeType * next_nodeType_list(struct nodeType * node)
  *      gets the next node in the list, null if none left
+ *
+ * void remove_nodeType_list(nodeType_list_t * list, struct nodeType *)
+ *      unlinks a node from anywhere in the list
  */
 #include <stddef.h>
 #include <stdint.h>
@@ -54,7 +57,9 @@ struct nodeType * prev##nodeType;
 
 #define IMPLEMENT_LIST(nodeType) \
 void append_##nodeType##_list(nodeType##_list_t * list, struct nodeType * node) {  \
-    list->tail->next##nodeType = node;                                       \
+    if (list->tail != NULL) {                                                \
+        list->tail->next##nodeType = node;                                   \
+    }                                                                        \
     node->prev##nodeType = list->tail;                                       \
     list->tail = node;                                                       \
     node->next##nodeType = NULL;                                             \
@@ -67,6 +72,9 @@ void append_##nodeType##_list(nodeType##_list_t * list, struct nodeType * node)
 void push_##nodeType##_list(nodeType##_list_t * list, struct nodeType * node) {    \
     node->next##nodeType = list->head;                                       \
     node->prev##nodeType = NULL;                                             \
+    if (list->head != NULL) {                                                \
+        list->head->prev##nodeType = node;                                   \
+    }                                                                        \
     list->head = node;                                                       \
     list->size += 1;                                                         \
     if (list->tail == NULL) {                                                \
@@ -80,12 +88,17 @@ struct nodeType * peek_##nodeType##_list(nodeType##_list_t * list) {         \
                                                                              \
 struct nodeType * pop_##nodeType##_list(nodeType##_list_t * list) {          \
     struct nodeType * res = list->head;                                      \
-    list->head = list->head->next##nodeType;                                 \
-    list->head->prev##nodeType = NULL;                                                 \
+    if (res == NULL) {                                                       \
+        return NULL;                                                         \
+    }                                                                        \
+    list->head = res->next##nodeType;                                        \
     list->size -= 1;                                                         \
     if (list->head == NULL) {                                                \
-        list->tail = NULL;                                                  \
+        list->tail = NULL;                                                   \
+    } else {                                                                 \
+        list->head->prev##nodeType = NULL;                                   \
     }                                                                        \
+    res->next##nodeType = NULL;                                              \
     return res;                                                              \
 }                                                                            \
                                                                              \
@@ -96,5 +109,20 @@ uint32_t size_##nodeType##_list(nodeType##_list_t * list) {                  \
 struct nodeType * next_##nodeType##_list(struct nodeType * node) {           \
     return node->next##nodeType;                                             \
 }                                                                            \
+                                                                             \
+void remove_##nodeType##_list(nodeType##_list_t * list, struct nodeType * node) {  \
+    if (node->prev##nodeType != NULL) {                                      \
+        node->prev##nodeType->next##nodeType = node->next##nodeType;         \
+    } else {                                                                 \
+        list->head = node->next##nodeType;                                   \
+    }                                                                        \
+    if (node->next##nodeType != NULL) {                                      \
+        node->next##nodeType->prev##nodeType = node->prev##nodeType;         \
+    } else {                                                                 \
+        list->tail = node->prev##nodeType;                                   \
+    }                                                                        \
+    node->next##nodeType = node->prev##nodeType = NULL;                      \
+    list->size -= 1;                                                         \
+}                                                                            \
 
 #endif
@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <kernel/peripheral.h>
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#define MAILBOX_BASE (PERIPHERAL_BASE + 0xB880)
+
+enum {
+    MAIL0_READ   = (MAILBOX_BASE + 0x00),
+    MAIL0_STATUS = (MAILBOX_BASE + 0x18),
+    MAIL0_WRITE  = (MAILBOX_BASE + 0x20),
+};
+
+#define MAILBOX_FULL  0x80000000
+#define MAILBOX_EMPTY 0x40000000
+
+// The GPU sees ARM memory through a bus alias.  This one bypasses the L2 cache
+#ifdef MODEL_1
+#define MAILBOX_BUS_OFFSET 0x40000000
+#else
+#define MAILBOX_BUS_OFFSET 0xC0000000
+#endif
+// Strips the alias off a bus address the GPU hands back, leaving the ARM physical address
+#define MAILBOX_BUS_TO_PHYS(addr) ((addr) & 0x3FFFFFFF)
+
+typedef enum {
+    MAILBOX_CHANNEL_FRAMEBUFFER = 1,
+    MAILBOX_CHANNEL_PROPERTY = 8,   // ARM -> VC property tags
+} mailbox_channel_t;
+
+// Request/response codes in the second word of a property buffer
+#define MAILBOX_REQUEST  0x00000000
+#define MAILBOX_RESPONSE_SUCCESS 0x80000000
+
+typedef enum {
+    MAILBOX_TAG_END = 0x00000000,
+    MAILBOX_TAG_GET_ARM_MEMORY = 0x00010005,
+    MAILBOX_TAG_GET_CLOCK_RATE = 0x00030002,
+    MAILBOX_TAG_SET_CLOCK_RATE = 0x00038002,
+    MAILBOX_TAG_ALLOCATE_BUFFER = 0x00040001,
+    MAILBOX_TAG_GET_PITCH = 0x00040008,
+    MAILBOX_TAG_SET_PHYSICAL_SIZE = 0x00048003,
+    MAILBOX_TAG_SET_VIRTUAL_SIZE = 0x00048004,
+    MAILBOX_TAG_SET_DEPTH = 0x00048005,
+    MAILBOX_TAG_SET_PIXEL_ORDER = 0x00048006,
+    MAILBOX_TAG_SET_VIRTUAL_OFFSET = 0x00048009,
+} mailbox_tag_t;
+
+typedef enum {
+    MAILBOX_CLOCK_EMMC = 1,
+    MAILBOX_CLOCK_UART = 2,
+    MAILBOX_CLOCK_ARM = 3,
+    MAILBOX_CLOCK_CORE = 4,
+} mailbox_clock_t;
+
+// Largest property request, in words
+#define MAILBOX_BUFFER_WORDS 64
+
+// Send a 16 byte aligned buffer to the VideoCore on the given channel and wait for the reply.
+// A property request is copied through a cache line aligned buffer of MAILBOX_BUFFER_WORDS; any
+// other channel is posted as is and the caller does the cache maintenance.  Returns 0 on success,
+// -1 if the firmware rejected a property request or it doesn't fit
+int mailbox_call(mailbox_channel_t channel, volatile uint32_t * buffer);
+
+// Get the base and size of the memory the firmware gives to the ARM.  Returns 0 on success
+int mailbox_get_arm_memory(uint32_t * base, uint32_t * size);
+
+// Returns the clock rate in Hz, or 0 if the firmware doesn't know the clock
+uint32_t mailbox_get_clock_rate(mailbox_clock_t clock);
+// Returns the rate the clock was actually set to, or 0 on failure
+uint32_t mailbox_set_clock_rate(mailbox_clock_t clock, uint32_t rate);
+
+#endif
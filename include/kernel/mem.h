@@ -11,11 +11,12 @@ typedef struct {
 	uint8_t allocated: 1;			// This page is allocated to something
 	uint8_t kernel_page: 1;			// This page is a part of the kernel
 	uint8_t kernel_heap_page: 1;	// This page is a part of the kernel
-	uint32_t reserved: 29;
+	uint8_t initrd_page: 1;			// This page holds the initrd
+	uint32_t reserved: 28;
 } page_flags_t;
 
 typedef struct page {
-	uint32_t vaddr_mapped;	// The virtual address that maps to this page	
+	uint32_t vaddr_mapped;	// The virtual address that maps to this page, see vm.h
 	page_flags_t flags;
 	DEFINE_LINK(page);
 } page_t;
@@ -26,6 +27,22 @@ void mem_init(atag_t * atags);
 void * alloc_page(void);
 void free_page(void * ptr);
 
+// Allocate the count pages starting at addr, if every one of them is free.  Returns addr, or NULL
+void * alloc_pages_at(void * addr, uint32_t count);
+
+// Allocate count physically contiguous pages.  Returns the first, or NULL.  Free them one by one
+void * alloc_pages(uint32_t count);
+// Same, starting on a multiple of align pages, which must be a power of two
+void * alloc_pages_aligned(uint32_t count, uint32_t align);
+
+// Pages alloc_page can still hand out
+uint32_t mem_free_pages(void);
+// Pages of RAM, free or not
+uint32_t mem_num_pages(void);
+
+// The metadata for the page of RAM holding addr, NULL if addr isn't RAM
+page_t * mem_page(uintptr_t addr);
+
 void * kmalloc(uint32_t bytes);
 void kfree(void *ptr);
 
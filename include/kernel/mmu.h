@@ -0,0 +1,89 @@
+#include <stdint.h>
+
+#ifndef MMU_H
+#define MMU_H
+
+/**
+ * The page tables, in the ARMv7 short descriptor format (ARMv6 with SCTLR.XP set on the model 1).
+ * One 16 KB first level table covers the whole 4 GB in 1 MB entries, each either a section or a
+ * pointer to a 1 KB second level table of 4 KB entries.  A 64 KB large page is one descriptor
+ * repeated in 16 second level entries.  A section or large page takes one TLB entry where 4 KB
+ * pages would take 256 or 16.
+ *
+ * mmu_init identity maps RAM, the GPU's memory above it and the peripherals with sections, all
+ * global, and turns translation and the data cache on.  RAM is cached write back; the GPU's
+ * memory, which holds the framebuffer, is not.  Anything else that reads or writes RAM behind the
+ * CPU's back has to clean or invalidate it with the dcache_ calls: the mailbox does, and the SD
+ * card is read and written by the CPU a word at a time so it needs nothing.  RAM starts out
+ * kernel only; mmu_set_user_access opens pages of it to user mode.  Nothing else is open to user
+ * mode.
+ *
+ * The 64 bit build has no page tables yet: mmu_init fails there, the MMU and cache stay off and
+ * the dcache_ calls do nothing.  Callers serialise mmu_map and mmu_unmap (vm.c holds its lock).
+ */
+
+#define SECTION_SIZE 0x100000
+#define LARGE_PAGE_SIZE 0x10000
+
+#define MMU_NUM_ASIDS 256
+
+#ifdef MODEL_1
+#define CACHE_LINE_SIZE 32
+#else
+#define CACHE_LINE_SIZE 64
+#endif
+
+typedef enum {
+    MMU_USER_NONE,
+    MMU_USER_READ,
+    MMU_USER_WRITE,
+} mmu_user_access_t;
+
+typedef enum {
+    MMU_NORMAL,             // RAM
+    MMU_UNCACHED,           // Memory shared with the GPU
+    MMU_DEVICE,             // Peripheral registers, never executed
+} mmu_memory_t;
+
+// Identity map everything below the end of the peripherals and turn the MMU on.  Returns 0, or
+// -1 without page table support
+int mmu_init(uint32_t ram_size);
+int mmu_enabled(void);
+
+// Map size bytes at va to pa, for kernel access only.  size is SECTION_SIZE, LARGE_PAGE_SIZE or
+// PAGE_SIZE and both addresses are aligned to it.  Returns -1 if any of it is already mapped
+int mmu_map(uintptr_t va, uintptr_t pa, uint32_t size, mmu_memory_t type);
+// Remove a mapping made by mmu_map with the same size, and its TLB entry
+void mmu_unmap(uintptr_t va, uint32_t size);
+// Where va goes: stores the physical address and the size of the mapping holding it and
+// returns 0, or returns -1 if va isn't mapped
+int mmu_lookup(uintptr_t va, uintptr_t * pa, uint32_t * size);
+// 1 if nothing in the size aligned block at va is mapped
+int mmu_range_free(uintptr_t va, uint32_t size);
+
+// What user mode may do with the page aligned range of RAM at va.  The sections it falls in are
+// split into pages the first time.  Returns -1 if va isn't RAM or there is no memory to split
+int mmu_set_user_access(uintptr_t va, uint32_t size, mmu_user_access_t access);
+
+// For the data abort handler: 1 if the abort was a translation fault, with the address in *addr
+int mmu_translation_fault(uintptr_t * addr);
+
+// Data cache maintenance by address, to the point of coherency.  Clean before something else
+// reads memory the CPU wrote, invalidate before the CPU reads memory something else wrote.  The
+// invalidate drops whole lines, so buffers should be aligned to and a multiple of CACHE_LINE_SIZE
+void dcache_clean(const void * addr, uint32_t size);
+void dcache_invalidate(const void * addr, uint32_t size);
+void dcache_clean_invalidate(const void * addr, uint32_t size);
+// Write every dirty line back, before the caches are turned off
+void dcache_clean_all(void);
+
+// TLB maintenance, finished with the barriers that make it take effect
+void tlb_flush_all(void);
+void tlb_flush_page(uintptr_t va);          // Any mapping of va, global or in any ASID
+void tlb_flush_asid(uint32_t asid);         // Every non-global entry tagged with asid
+
+// The address space identifier non-global TLB entries are tagged with
+void mmu_set_asid(uint32_t asid);
+uint32_t mmu_get_asid(void);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef PERIPHERAL_H
+#define PERIPHERAL_H
+
+// Base address of the memory mapped peripherals as seen by the ARM core.
+// Model 1 puts them at 0x20000000, models 2 and 3 moved them to 0x3F000000
+#ifdef MODEL_1
+#define PERIPHERAL_BASE 0x20000000
+#else
+#define PERIPHERAL_BASE 0x3F000000
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#include <stdint.h>
+
+#ifndef PRINTK_H
+#define PRINTK_H
+
+/**
+ * The kernel log.  printk formats a message into the next record of a ring and returns; it never
+ * waits for the UART, takes no locks and works in interrupt context, so error paths stay cheap.
+ * A writer claims a record with one atomic add on the head, fills it in, and publishes it by
+ * storing its sequence number.  Once the ring is full the oldest records are overwritten.
+ *
+ * printk_drain copies records out to the console sinks (see stdio.h) from the shell's idle loop:
+ * a whole line at a time to the screen, as much as the UART FIFO takes without waiting.  Only
+ * records at or above the console level go out, at most LOG_CONSOLE_RATE lines a second after a
+ * burst of LOG_CONSOLE_BURST; the rest are counted and reported as suppressed.  `dmesg` replays
+ * the whole ring, whatever the level, and these counts.
+ *
+ * Formats understand %s, %d, %u, %x and %%.  Messages longer than LOG_TEXT_LEN are cut short.
+ */
+
+#define LOG_RING_SIZE 256           // Records, must be a power of two
+#define LOG_TEXT_LEN 112
+#define LOG_CONSOLE_RATE 20
+#define LOG_CONSOLE_BURST 10
+
+typedef enum {
+    LOG_ERR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+} log_level_t;
+
+#define LOG_DEFAULT_CONSOLE_LEVEL LOG_INFO
+
+typedef struct {
+    volatile uint32_t seq;      // Index in the log + 1 once published, 0 while being written
+    uint8_t level;
+    uint8_t cpu;
+    uint16_t len;
+    uint64_t timestamp;         // Microseconds since boot
+    char text[LOG_TEXT_LEN];
+} log_record_t;
+
+typedef struct {
+    uint32_t written;           // Records ever logged
+    uint32_t overwritten;       // Overwritten before the console got to them
+    uint32_t suppressed;        // Held back from the console by the rate limit
+    uint32_t filtered;          // Below the console level
+} log_stats_t;
+
+// Set up the console side.  printk itself works from the first instruction
+void printk_init(void);
+
+void printk(log_level_t level, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+// Send pending records to the console without waiting for the UART.  Thread context only
+void printk_drain(void);
+
+// Print every record still in the ring, oldest first, to the console sinks, waiting for the UART
+void printk_dump(void);
+
+void printk_set_console_level(log_level_t level);
+log_level_t printk_console_level(void);
+
+void printk_get_stats(log_stats_t * stats);
+
+#endif
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <kernel/atag.h>
+
+#ifndef RAMFS_H
+#define RAMFS_H
+
+/**
+ * A read only filesystem over the initrd, which is a cpio archive in the "newc" format
+ * (`find . | cpio -o -H newc > initrd.cpio`).  Nothing is copied: names and file contents
+ * are pointers into the initrd pages, which mem_init keeps off the free list.
+ */
+
+// Run at boot if the initrd has it
+#define RAMFS_BOOT_SCRIPT "etc/rc"
+
+// cpio mode bits
+#define RAMFS_MODE_TYPE 0170000
+#define RAMFS_MODE_DIR  0040000
+#define RAMFS_MODE_FILE 0100000
+
+#define RAMFS_IS_DIR(file) (((file)->mode & RAMFS_MODE_TYPE) == RAMFS_MODE_DIR)
+
+typedef struct ramfs_file {
+    const char * name;          // Path without any leading "./" or "/", NUL terminated in the initrd
+    const uint8_t * data;
+    uint32_t size;
+    uint32_t mode;
+    uint32_t mtime;
+    uint32_t hash;
+} ramfs_file_t;
+
+typedef struct {
+    uint32_t size;
+    uint32_t mode;
+    uint32_t mtime;
+} ramfs_stat_t;
+
+// Index the initrd named by the ATAGS.  Returns 0 on success, -1 if there is no usable initrd
+int ramfs_init(atag_t * atags);
+
+// Find a file by path in O(1).  Returns NULL if there is no such file
+const ramfs_file_t * ramfs_open(const char * path);
+
+// Point *data at up to len bytes of the file starting at offset.  Returns how many bytes are there
+uint32_t ramfs_read(const ramfs_file_t * file, uint32_t offset, uint32_t len, const uint8_t ** data);
+
+// Returns 0 and fills in st if path exists, -1 otherwise
+int ramfs_stat(const char * path, ramfs_stat_t * st);
+
+// The files in archive order, for listing
+uint32_t ramfs_count(void);
+const ramfs_file_t * ramfs_entry(uint32_t i);
+
+#endif
@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <kernel/cpu.h>
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+/**
+ * Every lock keeps counters of how often it was taken and how often it had to wait, so hot locks
+ * show up in the `locks` shell command.  Locks only appear there once spin_lock_init/rwlock_init
+ * registered them.  Only core 0 runs, so no lock is ever fought over by two cores and the
+ * contention counters stay at 0 unless a task is switched out while holding one.
+ */
+typedef struct lock_stats {
+    const char * name;
+    volatile uint32_t acquisitions;
+    volatile uint32_t contended;    // Acquisitions that found the lock taken
+    volatile uint32_t spins;        // Times a waiter went round its wait loop
+    struct lock_stats * next;
+} lock_stats_t;
+
+/**
+ * Ticket lock: taking the lock draws a ticket by incrementing next, and waits until owner
+ * reaches it.  Waiters get the lock in the order they arrived.
+ */
+typedef struct {
+    union {
+        volatile uint32_t value;
+        struct {
+            volatile uint16_t owner;    // Ticket being served
+            volatile uint16_t next;     // Next ticket to hand out
+        };
+    };
+    lock_stats_t stats;
+} spinlock_t;
+
+/**
+ * Reader/writer lock: any number of readers, or one writer.  The top bit of value is set while a
+ * writer holds it, the rest counts the readers.
+ */
+typedef struct {
+    volatile uint32_t value;
+    lock_stats_t stats;
+} rwlock_t;
+
+void spin_lock_init(spinlock_t * lock, const char * name);
+void spin_lock(spinlock_t * lock);
+void spin_unlock(spinlock_t * lock);
+// Take the lock only if nobody holds it.  Returns 1 if we got it
+int spin_trylock(spinlock_t * lock);
+
+// Also mask IRQs on this core, for locks that interrupt handlers take too
+uintptr_t spin_lock_irqsave(spinlock_t * lock);
+void spin_unlock_irqrestore(spinlock_t * lock, uintptr_t flags);
+
+void rwlock_init(rwlock_t * lock, const char * name);
+void read_lock(rwlock_t * lock);
+void read_unlock(rwlock_t * lock);
+void write_lock(rwlock_t * lock);
+void write_unlock(rwlock_t * lock);
+
+// The registered locks, for reporting
+lock_stats_t * lock_stats_list(void);
+void lock_stats_reset(void);
+
+#endif
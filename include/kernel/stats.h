@@ -0,0 +1,28 @@
+#include <stdint.h>
+
+#ifndef STATS_H
+#define STATS_H
+
+/**
+ * A periodic timer samples a few system counters once a second into a ring, so `stats` can show
+ * how they moved over the last minute without anything having to be watching at the time.
+ */
+
+#define STATS_PERIOD_MS 1000
+#define STATS_SAMPLES 60
+
+typedef struct {
+    uint32_t tick;              // timer_get_tick_count() when taken
+    uint32_t free_pages;
+    uint32_t pending_timers;
+    uint32_t interrupts;        // Running totals, the deltas between samples are the rates
+    uint32_t timer_callbacks;
+} stats_sample_t;
+
+// Start sampling.  Needs timer_init first
+void stats_init(void);
+
+// Print the last count samples, oldest first
+void stats_print(uint32_t count);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+/**
+ * System calls from user tasks.  The number goes in r7 (x8 on AArch64), up to three arguments in
+ * r0-r2 (x0-x2), and the result comes back in r0 (x0).  Like a function call, a system call may
+ * change the caller saved registers: r1-r3 and r12 (x1-x18).
+ *
+ * The numbers below SYSCALL_FAST_COUNT are short and never switch tasks, so the vector handles
+ * them on a register-only fast path: no trap frame, interrupts stay masked, straight into the
+ * handler from syscall_fast_table.  The rest save the whole user context in a trap frame first, so they can
+ * block, yield or exit.
+ *
+ * This header is included from the vectors, so keep anything but #defines under __ASSEMBLER__.
+ */
+
+#define SYS_GETPID  0   // () -> task id
+#define SYS_TIME    1   // () -> milliseconds since boot
+#define SYS_SBRK    2   // (increment) -> previous break, or -1
+#define SYS_WRITE   3   // (fd, buf, len) -> bytes written, or -1
+#define SYS_READ    4   // (fd, buf, len) -> bytes read, or -1.  Waits for at least one
+#define SYS_YIELD   5   // () -> 0
+#define SYS_EXIT    6   // (code), doesn't return
+
+#define SYSCALL_FAST_COUNT 3
+#define SYSCALL_COUNT 7
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#include <kernel/cpu.h>
+
+typedef uintptr_t (*syscall_f)(uintptr_t arg0, uintptr_t arg1, uintptr_t arg2);
+
+extern const syscall_f syscall_fast_table[SYSCALL_FAST_COUNT];
+
+// Slow path, called from the vector with the trap frame it built
+void syscall_dispatch(trap_frame_t * frame);
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/list.h>
+#include <kernel/vdso.h>
+
+#ifndef TASK_H
+#define TASK_H
+
+/**
+ * User mode tasks.  Each one gets a page of kernel stack, which holds its trap frame while it is
+ * in the kernel, and TASK_USER_PAGES contiguous pages of its own: the heap grows up from the
+ * bottom with sbrk and the user stack grows down from the top.
+ *
+ * Scheduling is cooperative and runs on core 0 from the shell.  task_schedule switches to each
+ * ready task in turn, and a task comes back to it by yielding, waiting for input, exiting or
+ * faulting.  Tasks run unprivileged.  User mode can read the kernel image, where the user
+ * programs are, and the vDSO page.  While a task runs it can also read and write its own user
+ * pages, and nothing else (see vm_user_access).
+ */
+
+#define TASK_NAME_LEN 16
+#define TASK_USER_PAGES 16
+#define TASK_STACK_PAGES 4
+
+// A task's code: user programs are linked into the kernel image.  arg is what task_create was
+// given, and vdso the shared page with the kernel's clocks and counters.  Returning is exit
+typedef int (*task_entry_t)(uintptr_t arg, const vdso_page_t * vdso);
+
+typedef enum {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_DEAD,
+} task_state_t;
+
+DEFINE_LIST(task);
+
+typedef struct task {
+    uint32_t id;
+    char name[TASK_NAME_LEN];
+    task_state_t state;
+    int exit_code;
+    cpu_context_t context;      // Kernel registers while switched out
+    uint8_t * kstack;
+    uint8_t * user_base;        // TASK_USER_PAGES pages
+    uintptr_t brk;              // End of the heap
+    DEFINE_LINK(task);
+} task_t;
+
+// Create a task that starts running entry(arg, vdso) in user mode the next time task_schedule
+// runs.  Returns its id, or -1 if there is no memory
+int task_create(const char * name, task_entry_t entry, uintptr_t arg);
+
+// Run tasks until every one of them has exited
+void task_schedule(void);
+
+// Give up the CPU to the other ready tasks.  Only from a task's kernel side, i.e. a system call
+void task_yield(void);
+
+// End the current task
+void task_exit(int code) __attribute__((noreturn));
+
+// The task whose system call or fault we are handling, NULL in the shell
+task_t * task_current(void);
+
+// 1 if [addr, addr + len) is memory the task may hand to a system call: its own pages, or for
+// reading, also the kernel image its code and strings live in
+int task_access_ok(const task_t * task, uintptr_t addr, uintptr_t len, int write);
+
+// Tasks not yet exited
+uint32_t task_count(void);
+
+// Switches into a task since boot
+uint32_t task_switch_count(void);
+
+#endif
@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <kernel/list.h>
+#include <kernel/peripheral.h>
+
+#ifndef TIMER_H
+#define TIMER_H
+
+// The BCM2835 system timer is a free running 64 bit counter ticking at 1 MHz
+#define SYSTEM_TIMER_BASE (PERIPHERAL_BASE + 0x3000)
+#define SYSTEM_TIMER_HZ 1000000
+
+enum {
+    SYSTEM_TIMER_CS  = (SYSTEM_TIMER_BASE + 0x00),
+    SYSTEM_TIMER_CLO = (SYSTEM_TIMER_BASE + 0x04),
+    SYSTEM_TIMER_CHI = (SYSTEM_TIMER_BASE + 0x08),
+    SYSTEM_TIMER_C0  = (SYSTEM_TIMER_BASE + 0x0C),
+    SYSTEM_TIMER_C1  = (SYSTEM_TIMER_BASE + 0x10),
+    SYSTEM_TIMER_C2  = (SYSTEM_TIMER_BASE + 0x14),
+    SYSTEM_TIMER_C3  = (SYSTEM_TIMER_BASE + 0x18),
+};
+
+// Control/status bits: writing one clears the match flag of a compare register
+#define SYSTEM_TIMER_MATCH(n) (1 << (n))
+
+/**
+ * Timers run off a 1 kHz tick from compare register 1 (0 and 2 belong to the GPU firmware).
+ *
+ * Pending timers live in a hierarchical timing wheel: a root wheel of 256 slots, one per tick,
+ * then three levels of 64 slots that each cover 64 times the span of the one below.  A timer goes
+ * straight into the slot for its expiry tick, so adding and cancelling are O(1) whatever the
+ * number of timers.  Whenever the root wheel wraps, the next slot of the level above is emptied
+ * into the level below (cascading), so a timer is moved at most once per level before it fires.
+ * That caps the timeout at 2^26 ticks, about 18 hours; longer ones are clamped.
+ *
+ * Each tick interrupt runs every timer due since the last one in a single batch.  Callbacks run
+ * in interrupt context: they may add and cancel timers, but must not block or print.
+ */
+#define TIMER_TICK_MS 1
+#define TIMER_TICK_US (TIMER_TICK_MS * 1000)
+#define TIMER_MS_TO_TICKS(ms) (((ms) + TIMER_TICK_MS - 1) / TIMER_TICK_MS)
+
+#define TIMER_ROOT_BITS 8
+#define TIMER_LEVEL_BITS 6
+#define TIMER_LEVELS 3
+#define TIMER_ROOT_SIZE (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SIZE (1 << TIMER_LEVEL_BITS)
+#define TIMER_MAX_TICKS ((1 << (TIMER_ROOT_BITS + TIMER_LEVELS * TIMER_LEVEL_BITS)) - 1)
+
+typedef void (*timer_callback_t)(void * data);
+
+DEFINE_LIST(timer);
+
+typedef struct timer {
+    uint32_t expires;           // Tick it fires on
+    uint32_t period;            // Ticks between firings, 0 for a one shot timer
+    timer_callback_t callback;
+    void * data;
+    timer_list_t * slot;        // Wheel slot it is waiting in, NULL when not pending
+    DEFINE_LINK(timer);
+} timer_t;
+
+typedef struct {
+    uint32_t ticks;             // Ticks processed
+    uint32_t interrupts;        // Tick interrupts taken.  Fewer than ticks if some were late
+    uint32_t expired;           // Callbacks run
+    uint32_t cascaded;          // Timers moved down a level
+    uint32_t pending;           // Timers waiting right now
+    uint32_t max_irq_cycles;    // Longest tick interrupt, in CPU cycles
+    uint64_t total_irq_cycles;
+} timer_stats_t;
+
+// Start the tick.  Needs interrupts_init first
+void timer_init(void);
+
+void timer_setup(timer_t * timer, timer_callback_t callback, void * data);
+
+// (Re)arm timer to fire once, at least msecs milliseconds from now
+void timer_add(timer_t * timer, uint32_t msecs);
+
+// (Re)arm timer to fire every msecs milliseconds until cancelled
+void timer_add_periodic(timer_t * timer, uint32_t msecs);
+
+// Stop timer.  Returns 1 if it was pending, 0 if it had already fired or was never added
+int timer_cancel(timer_t * timer);
+
+int timer_pending(const timer_t * timer);
+
+// Ticks since timer_init
+uint32_t timer_get_tick_count(void);
+
+void timer_get_stats(timer_stats_t * stats);
+void timer_reset_stats(void);
+
+// Microseconds since boot, low 32 bits.  Wraps after ~71 minutes, so only use it for differences
+uint32_t timer_get_ticks(void);
+
+// Microseconds since boot
+uint64_t timer_get_ticks64(void);
+
+// Busy wait for at least usecs microseconds
+void udelay(uint32_t usecs);
+
+#endif
@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <kernel/cpu.h>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Binary tracepoints.  Each core appends fixed size records to its own ring, so the hot path
+ * takes no locks: fill in the slot after head, then publish it with a single store of the new
+ * head.  Once the ring is full the oldest records are overwritten.
+ *
+ * `tracedump` streams the rings over the UART and tools/tracedecode.py turns them into a timeline.
+ */
+
+#define TRACE_RING_SIZE 4096        // Records per core, must be a power of two
+
+// Keep in sync with EVENTS in tools/tracedecode.py
+typedef enum {
+    TRACE_KMALLOC = 1,      // arg0: bytes, arg1: address
+    TRACE_KFREE,            // arg0: address
+    TRACE_ALLOC_PAGE,       // arg0: address
+    TRACE_FREE_PAGE,        // arg0: address
+    TRACE_UART_PUTC,        // arg0: character
+    TRACE_UART_GETC,        // arg0: character
+    TRACE_UART_WRITE,       // arg0: bytes
+    TRACE_SHELL_COMMAND,    // arg0: first 4 characters of the command, arg1: command length
+} trace_event_t;
+
+typedef struct {
+    uint32_t timestamp;     // cpu_cycles()
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_record_t;
+
+typedef struct {
+    trace_record_t records[TRACE_RING_SIZE];
+    volatile uint32_t head;     // Records ever written.  Slot is head % TRACE_RING_SIZE
+} trace_ring_t;
+
+extern trace_ring_t trace_rings[NUM_CPUS];
+extern volatile uint32_t trace_enabled;
+
+void trace_init(void);
+
+static inline void trace(trace_event_t event, uint32_t arg0, uint32_t arg1)
+{
+    trace_ring_t * ring;
+    trace_record_t * rec;
+    uint32_t head;
+
+    if (!trace_enabled)
+        return;
+
+    ring = &trace_rings[cpu_id()];
+    head = ring->head;
+    rec = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    rec->timestamp = cpu_cycles();
+    rec->event = event;
+    rec->cpu = cpu_id();
+    rec->arg0 = arg0;
+    rec->arg1 = arg1;
+
+    // The record must be complete before the head store makes it visible
+    asm volatile("" ::: "memory");
+    ring->head = head + 1;
+}
+
+// Forget every recorded event
+void trace_clear(void);
+
+// Stream every ring over the UART in the binary format tools/tracedecode.py reads.
+// Tracing is paused while the dump runs so it doesn't record itself
+void trace_dump(void);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stddef.h>
 #include <stdint.h>
+#include <kernel/peripheral.h>
 
 #ifndef UART_H
 #define UART_H
@@ -50,11 +51,7 @@ void delay(int32_t count);
 enum
 {
     // The GPIO registers base address.
-#ifdef MODEL_1
-    GPIO_BASE = 0x20200000, 
-#else
-    GPIO_BASE = 0x3F200000, 
-#endif
+    GPIO_BASE = (PERIPHERAL_BASE + 0x200000),
 
 
     // The offsets for reach register.
@@ -66,11 +63,7 @@ enum
     GPPUDCLK0 = (GPIO_BASE + 0x98),
 
     // The base address for UART.
-#ifdef MODEL_1
-    UART0_BASE = 0x20201000, 
-#else
-    UART0_BASE = 0x3F201000, 
-#endif
+    UART0_BASE = (PERIPHERAL_BASE + 0x201000),
 
     // The offsets for reach register for the UART.
     UART0_DR     = (UART0_BASE + 0x00),
@@ -93,13 +86,64 @@ enum
     UART0_TDR    = (UART0_BASE + 0x8C),
 };
 
+// Bits of UART0_RIS/UART0_MIS/UART0_ICR
+#define UART_INT_RX (1 << 4)
+#define UART_INT_TX (1 << 5)
+
+// Depth of the PL011 transmit and receive FIFOs
+#define UART_FIFO_DEPTH 16
+
+#define UART_DEFAULT_BAUD 115200
+// Clock assumed when the firmware can't tell us the real one (the old raspi default)
+#define UART_DEFAULT_CLOCK 3000000
+// Clock we ask the firmware for when a baud rate is out of reach of the current one
+#define UART_FAST_CLOCK 48000000
+
+// FIFO trigger levels for UART0_IFLS.  The interrupt (and raw interrupt status) for a
+// direction fires once the FIFO crosses this fraction of its depth
+typedef enum {
+    UART_FIFO_1_8 = 0,
+    UART_FIFO_1_4 = 1,
+    UART_FIFO_1_2 = 2,
+    UART_FIFO_3_4 = 3,
+    UART_FIFO_7_8 = 4,
+} uart_fifo_level_t;
+
 void uart_init();
 
+// Reprogram the baud rate divisors from the real UART clock.  Returns 0 on success,
+// -1 if the rate can't be reached even after asking the firmware for a faster clock
+int uart_set_baud(uint32_t baud);
+// 1 if uart_set_baud(baud) would succeed.  It may ask the firmware for a faster clock to find
+// out, but the line keeps its current rate
+int uart_baud_supported(uint32_t baud);
+uint32_t uart_get_baud(void);
+uint32_t uart_get_clock(void);
+
+// Returns 0, or -1 if either level isn't one of the above
+int uart_set_fifo_levels(uart_fifo_level_t tx_level, uart_fifo_level_t rx_level);
+
 uart_flags_t read_flags(void);
 
 void uart_putc(unsigned char c);
 
+// uart_putc without the lock or the tracepoint, for when the lock holder may never run again (panics)
+void uart_putc_raw(unsigned char c);
+
 unsigned char uart_getc();
 
+// Wait at most usecs microseconds for a character.  Returns it, or -1 on timeout
+int uart_getc_timeout(uint32_t usecs);
+
+// Transmit len bytes, filling the FIFO with as many bytes as are free per flag read
+void uart_write(const char * buf, size_t len);
+
+// Queue as much of buf as the transmit FIFO has room for right now, without waiting.  Returns the
+// bytes taken, 0 if the FIFO is full or another writer holds the UART
+size_t uart_try_write(const char * buf, size_t len);
+
 void uart_puts(const char* str);
+
+// Wait until every queued byte has left the transmitter
+void uart_flush(void);
 #endif
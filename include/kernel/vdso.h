@@ -0,0 +1,35 @@
+#include <stdint.h>
+
+#ifndef VDSO_H
+#define VDSO_H
+
+/**
+ * A page the kernel keeps up to date and every task gets a pointer to, so reading the time or the
+ * system counters costs a few loads instead of a system call.
+ *
+ * A periodic timer rewrites it every VDSO_PERIOD_MS.  It is guarded by a sequence count: the
+ * writer makes seq odd, updates the fields and makes it even again, so a reader copies the fields
+ * out between two reads of an even, unchanged seq (vdso_read in ulib does this).
+ */
+
+#define VDSO_PERIOD_MS 1
+
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t tick_ms;           // Milliseconds per tick
+    uint32_t ticks;             // Timer ticks since boot
+    uint32_t free_pages;
+    uint64_t uptime_us;         // System timer when last updated
+    uint32_t interrupts;
+    uint32_t context_switches;
+    uint32_t tasks;
+    uint32_t updates;           // Times the page has been written
+} vdso_page_t;
+
+// Allocate the page and start updating it.  Needs timer_init first
+void vdso_init(void);
+
+// The page, NULL before vdso_init
+const vdso_page_t * vdso_page(void);
+
+#endif
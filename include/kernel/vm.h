@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <kernel/list.h>
+#include <kernel/mmu.h>
+
+#ifndef VM_H
+#define VM_H
+
+/**
+ * Kernel virtual memory: mappings of physical ranges (kmap) and virtually contiguous
+ * allocations (vmalloc) in the VM_START - VM_END window above the identity mapped memory.
+ *
+ * Both map with the biggest pieces alignment allows, 1 MB sections, then 64 KB large pages,
+ * then 4 KB pages, to use as few TLB entries as possible.  kmap places the range so its virtual
+ * address lines up with the physical one.  vmalloc only reserves addresses: the first touch of
+ * each piece faults, and vm_fault backs it with zeroed pages, a whole section or large page at
+ * a time when the area covers it and memory that aligned is free.
+ *
+ * While a page of RAM is mapped here, its page_t.vaddr_mapped holds the address it is mapped
+ * at, otherwise its identity address.
+ *
+ * Without an MMU (the 64 bit build) addresses are physical: kmap hands back the address it was
+ * given and vmalloc allocates contiguous pages up front.
+ */
+
+#define VM_START 0x80000000
+#define VM_END 0xC0000000
+#define VM_GRANULE 0x10000          // Addresses are handed out in 64 KB steps
+
+// Flags for kmap and vmalloc
+#define VM_DEVICE 0x1               // Peripheral registers
+#define VM_UNCACHED 0x2             // Memory the GPU also uses
+#define VM_NO_SECTIONS 0x4          // Nothing bigger than a large page
+#define VM_SMALL_PAGES 0x8          // 4 KB pages only
+// Set by vmalloc
+#define VM_LAZY 0x100               // Backed on first touch
+#define VM_DIRECT 0x200             // No MMU, the area is the physical pages
+
+typedef struct vm_area {
+    uintptr_t addr;                 // Page aligned start
+    uint32_t length;                // Bytes, a multiple of PAGE_SIZE
+    uintptr_t phys;                 // What kmap mapped it to
+    uint32_t flags;
+    uint32_t first_granule, granules;
+    DEFINE_LINK(vm_area);
+} vm_area_t;
+
+DEFINE_LIST(vm_area);
+
+typedef struct {
+    uint32_t areas;
+    uint32_t faults;                // First touches backed by vm_fault
+    uint32_t sections;              // Mappings of each size in place now
+    uint32_t large_pages;
+    uint32_t small_pages;
+} vm_stats_t;
+
+// Build the page tables and turn on the MMU.  Needs mem_init first.  Returns 0, or -1 if there
+// is no MMU support and addresses stay physical
+int vm_init(void);
+int vm_enabled(void);
+
+// Map size bytes of physical memory from phys.  Returns the address of phys, or NULL
+void * kmap(uintptr_t phys, uint32_t size, uint32_t flags);
+void kunmap(void * addr);
+
+// size bytes of zeroed memory, contiguous in virtual addresses only.  Returns NULL if there is
+// no room for it
+void * vmalloc(uint32_t size, uint32_t flags);
+void vfree(void * addr);
+
+// Back a first touch of vmalloc memory.  Returns 0 if the access can be retried
+int vm_fault(uintptr_t addr);
+
+// The physical address behind addr, and the address a page of RAM is seen at
+uintptr_t virt_to_phys(const void * addr);
+void * phys_to_virt(uintptr_t phys);
+
+// What user mode may do with the page aligned range of RAM at addr.  vm_init opens the kernel
+// image, where the user programs are, for reading; the rest of RAM is closed until this opens
+// it.  Returns -1 if there is no memory for the page tables.  Without an MMU nothing is enforced
+// and it always succeeds
+int vm_user_access(const void * addr, uint32_t size, mmu_user_access_t access);
+
+// ASIDs for tagging non-global mappings, 1 to MMU_NUM_ASIDS - 1.  0 is the kernel's.  Freeing
+// one drops its TLB entries so it can be handed out again.  asid_alloc returns -1 if none are free
+int asid_alloc(void);
+void asid_free(uint32_t asid);
+
+void vm_get_stats(vm_stats_t * stats);
+
+#endif
@@ -0,0 +1,37 @@
+#include <stdint.h>
+#include <kernel/task.h>
+
+#ifndef PROGRAMS_H
+#define PROGRAMS_H
+
+// The user programs linked into the kernel, for `spawn`
+
+typedef struct {
+    const char * name;
+    task_entry_t entry;
+    const char * usage;
+} user_program_t;
+
+// NULL if there is no such program
+const user_program_t * user_program_find(const char * name);
+
+// Print the programs and their usage
+void user_program_list(void);
+
+// `bench syscalls` runs this with one of the operations below as its argument, SYSBENCH_ITERATIONS
+// times, and times the whole task from the kernel side
+typedef enum {
+    SYSBENCH_NOTHING,       // The loop on its own, subtracted from the rest
+    SYSBENCH_GETPID,        // Fast path
+    SYSBENCH_TIME,          // Fast path
+    SYSBENCH_WRITE,         // Slow path, writing nothing
+    SYSBENCH_YIELD,         // Slow path and two switches, with no other task to run
+    SYSBENCH_VDSO,          // Reading the time from the shared page instead
+    SYSBENCH_OPS,
+} sysbench_op_t;
+
+#define SYSBENCH_ITERATIONS 10000
+
+int sysbench_main(uintptr_t op, const vdso_page_t * vdso);
+
+#endif
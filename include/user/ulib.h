@@ -0,0 +1,80 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/syscall.h>
+#include <kernel/vdso.h>
+
+#ifndef ULIB_H
+#define ULIB_H
+
+/**
+ * What user programs get instead of the kernel's functions: system call wrappers and a few
+ * helpers built on them.  User code runs unprivileged, so it must not call into the rest of the
+ * kernel, even the parts that look harmless (itoa reads the core number from a system register).
+ */
+
+static inline uintptr_t syscall3(uintptr_t number, uintptr_t arg0, uintptr_t arg1, uintptr_t arg2)
+{
+#ifdef __aarch64__
+    register uintptr_t x0 asm("x0") = arg0;
+    register uintptr_t x1 asm("x1") = arg1;
+    register uintptr_t x2 asm("x2") = arg2;
+    register uintptr_t x8 asm("x8") = number;
+    asm volatile("svc #0"
+                 : "+r"(x0), "+r"(x1), "+r"(x2)
+                 : "r"(x8)
+                 : "x3", "x4", "x5", "x6", "x7", "x9", "x10", "x11", "x12", "x13", "x14", "x15",
+                   "x16", "x17", "x18", "cc", "memory");
+    return x0;
+#else
+    register uintptr_t r0 asm("r0") = arg0;
+    register uintptr_t r1 asm("r1") = arg1;
+    register uintptr_t r2 asm("r2") = arg2;
+    register uintptr_t r7 asm("r7") = number;
+    asm volatile("svc #0"
+                 : "+r"(r0), "+r"(r1), "+r"(r2)
+                 : "r"(r7)
+                 : "r3", "r12", "cc", "memory");
+    return r0;
+#endif
+}
+
+static inline uint32_t sys_getpid(void)
+{
+    return syscall3(SYS_GETPID, 0, 0, 0);
+}
+
+static inline uint32_t sys_time(void)
+{
+    return syscall3(SYS_TIME, 0, 0, 0);
+}
+
+static inline void * sys_sbrk(intptr_t increment)
+{
+    return (void *)syscall3(SYS_SBRK, increment, 0, 0);
+}
+
+static inline intptr_t sys_write(int fd, const void * buf, size_t len)
+{
+    return syscall3(SYS_WRITE, fd, (uintptr_t)buf, len);
+}
+
+static inline intptr_t sys_read(int fd, void * buf, size_t len)
+{
+    return syscall3(SYS_READ, fd, (uintptr_t)buf, len);
+}
+
+static inline void sys_yield(void)
+{
+    syscall3(SYS_YIELD, 0, 0, 0);
+}
+
+// Not inline: a task's entry function returns here (task_create sets it as the return address)
+void sys_exit(int code) __attribute__((noreturn));
+
+void uputs(const char * s);
+void uput_uint(uint32_t value);
+
+// A consistent copy of the shared page
+void vdso_read(const vdso_page_t * vdso, vdso_page_t * copy);
+
+#endif
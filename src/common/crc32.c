@@ -0,0 +1,61 @@
+#include <common/crc32.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC32_POLY 0xEDB88320  // Reflected 0x04C11DB7
+
+// Slicing-by-4: crc32_table[k][b] is the CRC of byte b followed by k zero bytes, which lets the
+// main loop fold in a whole word with four independent lookups
+static uint32_t crc32_table[4][256];
+static int crc32_table_ready;
+
+static void crc32_init_table(void) {
+    uint32_t i, j, crc;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++)
+            crc = crc & 1 ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+        crc32_table[0][i] = crc;
+    }
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 4; j++)
+            crc32_table[j][i] = (crc32_table[j - 1][i] >> 8) ^ crc32_table[0][crc32_table[j - 1][i] & 0xFF];
+    }
+    crc32_table_ready = 1;
+}
+
+uint32_t crc32_update(uint32_t crc, const void * data, uint32_t len) {
+    const uint8_t * p = data;
+    uint32_t word;
+
+    if (!crc32_table_ready)
+        crc32_init_table();
+
+    // Bytes until the pointer is word aligned
+    while (len > 0 && ((uintptr_t)p & 3)) {
+        crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 4) {
+        word = crc ^ *(const uint32_t *)p;
+        crc = crc32_table[3][word & 0xFF] ^
+              crc32_table[2][(word >> 8) & 0xFF] ^
+              crc32_table[1][(word >> 16) & 0xFF] ^
+              crc32_table[0][word >> 24];
+        p += 4;
+        len -= 4;
+    }
+
+    while (len > 0) {
+        crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    return crc;
+}
+
+uint32_t crc32(const void * data, uint32_t len) {
+    return crc32_final(crc32_update(CRC32_INIT, data, len));
+}
@@ -1,3 +1,8 @@
+#include <stddef.h>
+#include <kernel/cpu.h>
+#include <kernel/fbcon.h>
+#include <kernel/printk.h>
+#include <kernel/timer.h>
 #include <kernel/uart.h>
 #include <common/stdio.h>
 #include <common/stdlib.h>
@@ -6,28 +11,84 @@ char getc(void) {
     return uart_getc();
 }
 
+static volatile uint32_t stdio_sinks = STDIO_SINK_UART;
+
+void stdio_set_sinks(uint32_t sinks) {
+    stdio_sinks = sinks;
+}
+
+uint32_t stdio_get_sinks(void) {
+    return stdio_sinks;
+}
+
 void putc(char c) {
-    uart_putc(c);
+    uint32_t sinks = stdio_sinks;
+
+    if (sinks & STDIO_SINK_UART)
+        uart_putc(c);
+    if (sinks & STDIO_SINK_FB)
+        fbcon_putc(c);
 }
 
 void puts(const char * str) {
-    int i;
-    for (i = 0; str[i] != '\0'; i ++)
-        putc(str[i]);
+    uint32_t sinks = stdio_sinks;
+
+    if (sinks & STDIO_SINK_UART)
+        uart_puts(str);
+    if (sinks & STDIO_SINK_FB)
+        fbcon_puts(str);
+}
+
+void write(const char * buf, size_t len) {
+    uint32_t sinks = stdio_sinks;
+
+    if (sinks & STDIO_SINK_UART)
+        uart_write(buf, len);
+    if (sinks & STDIO_SINK_FB)
+        fbcon_write(buf, len);
+}
+
+static void gets_expired(void * data) {
+    *(volatile int *)data = 1;
 }
 
 void gets(char *buf, int buflen) {
-    int i = 0;
-    char c;
+    gets_timeout(buf, buflen, 0);
+}
+
+int gets_timeout(char *buf, int buflen, uint32_t msecs) {
+    volatile int expired = 0;
+    timer_t timeout;
+    int i = 0, c;
+
+    if (msecs) {
+        timer_setup(&timeout, gets_expired, (void *)&expired);
+        timer_add(&timeout, msecs);
+    }
 
     // Process characters in real time
     while (1) {
-        c = getc();
+        if (expired) {
+            buf[i] = '\0';
+            return -1;
+        }
+        // Waiting for a key is when the kernel log gets to the console.  Then sleep until the
+        // next interrupt, the timer tick at the latest
+        if ((c = uart_getc_timeout(0)) < 0) {
+            printk_drain();
+            wfi();
+            continue;
+        }
+        // Every key press restarts the clock
+        if (msecs)
+            timer_add(&timeout, msecs);
 
         if (c == '\r' || c == '\n') { // enter
             putc('\n');
             buf[i] = '\0';
-            return;                  
+            if (msecs)
+                timer_cancel(&timeout);
+            return i;
         } else if (c == '\b' || c == 127) { // backspace
             if (i > 0) {
                 i--;
@@ -38,4 +99,4 @@ void gets(char *buf, int buflen) {
             putc(c);
         }
     }
-}	
+}
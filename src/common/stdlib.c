@@ -1,4 +1,6 @@
 #include <common/stdlib.h>
+#include <common/string.h>
+#include <kernel/cpu.h>
 void memcpy(void * dest, void * src, int bytes) {
     char * d = dest, * s = src;
     while (bytes--) {
@@ -14,39 +16,11 @@ void bzero(void * dest, int bytes) {
 }
 
 char * itoa(int i) {
-    static char intbuf[12];
-    int j = 0, isneg = 0;
-
-    if (i == 0) {
-        intbuf[0] = '0';
-        intbuf[1] = '\0';
-        return intbuf;
-    }
-
-    if (i < 0) {
-        isneg = 1;
-        i = -i;
-    }
-
-    while (i != 0) {
-       intbuf[j++] = '0' + (i % 10); 
-       i /= 10;
-    }
-
-    if (isneg)
-        intbuf[j++] = '-';
-
-    intbuf[j] = '\0';
-    j--;
-    i = 0;
-    while (i < j) {
-        isneg = intbuf[i];
-        intbuf[i] = intbuf[j];
-        intbuf[j] = isneg;
-        i++;
-        j--;
-    }
+    // One buffer per core, so cores don't scribble over each other's numbers.  Anything that
+    // needs two at once, or can't read the core number, wants itoa_r
+    static char intbufs[NUM_CPUS][ITOA_BUF_SIZE];
+    char * intbuf = intbufs[cpu_id()];
 
+    itoa_r(i, intbuf);
     return intbuf;
 }
-
@@ -0,0 +1,378 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <common/string.h>
+
+// Words read from char arrays, so tell the compiler they may alias anything
+typedef uintptr_t __attribute__((may_alias)) word_t;
+
+#define WORD_SIZE sizeof(word_t)
+#define ONES ((word_t)-1 / 0xFF)            // 0x01 in every byte
+#define HIGHS (ONES * 0x80)                 // 0x80 in every byte
+// Non-zero if any byte of x is zero.  The lowest flagged byte is always a real zero
+#define HAS_ZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+
+size_t strlen(const char * s) {
+    const char * p = s;
+    const word_t * w;
+
+    for (; (uintptr_t)p % WORD_SIZE; p++)
+        if (*p == '\0')
+            return p - s;
+    for (w = (const word_t *)p; !HAS_ZERO(*w); w++);
+    for (p = (const char *)w; *p != '\0'; p++);
+    return p - s;
+}
+
+int strcmp(const char * s1, const char * s2) {
+    const word_t * w1, * w2;
+
+    // Words only line up if both strings are equally far from a word boundary
+    if ((uintptr_t)s1 % WORD_SIZE == (uintptr_t)s2 % WORD_SIZE) {
+        for (; (uintptr_t)s1 % WORD_SIZE; s1++, s2++)
+            if (*s1 != *s2 || *s1 == '\0')
+                return (unsigned char)*s1 - (unsigned char)*s2;
+        w1 = (const word_t *)s1;
+        w2 = (const word_t *)s2;
+        while (*w1 == *w2 && !HAS_ZERO(*w1)) {
+            w1++;
+            w2++;
+        }
+        s1 = (const char *)w1;
+        s2 = (const char *)w2;
+    }
+    while (*s1 != '\0' && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return (unsigned char)*s1 - (unsigned char)*s2;
+}
+
+void * memchr(const void * s, int c, size_t n) {
+    const unsigned char * p = s;
+    const word_t * w;
+    word_t pattern = ONES * (unsigned char)c;
+
+    for (; n > 0 && (uintptr_t)p % WORD_SIZE; p++, n--)
+        if (*p == (unsigned char)c)
+            return (void *)p;
+    // XOR turns the bytes we want into zeros
+    for (w = (const word_t *)p; n >= WORD_SIZE && !HAS_ZERO(*w ^ pattern); w++, n -= WORD_SIZE);
+    for (p = (const unsigned char *)w; n > 0; p++, n--)
+        if (*p == (unsigned char)c)
+            return (void *)p;
+    return NULL;
+}
+
+char * strchr(const char * s, int c) {
+    const word_t * w;
+    word_t pattern = ONES * (unsigned char)c, x;
+
+    for (; (uintptr_t)s % WORD_SIZE; s++) {
+        if (*s == (char)c)
+            return (char *)s;
+        if (*s == '\0')
+            return NULL;
+    }
+    for (w = (const word_t *)s; x = *w, !HAS_ZERO(x) && !HAS_ZERO(x ^ pattern); w++);
+    for (s = (const char *)w; *s != (char)c; s++)
+        if (*s == '\0')
+            return NULL;
+    return (char *)s;
+}
+
+void * memmove(void * dest, const void * src, size_t n) {
+    unsigned char * d = dest;
+    const unsigned char * s = src;
+    word_t * wd;
+    const word_t * ws;
+
+    if (d == s || n == 0)
+        return dest;
+    // Copy forwards when moving down and backwards when moving up, so overlap is fine either
+    // way.  Words when both ends are equally aligned, which whole rows of pixels always are
+    if (d < s) {
+        if ((uintptr_t)d % WORD_SIZE == (uintptr_t)s % WORD_SIZE) {
+            for (; n > 0 && (uintptr_t)d % WORD_SIZE; n--)
+                *d++ = *s++;
+            for (wd = (word_t *)d, ws = (const word_t *)s; n >= WORD_SIZE; n -= WORD_SIZE)
+                *wd++ = *ws++;
+            d = (unsigned char *)wd;
+            s = (const unsigned char *)ws;
+        }
+        while (n--)
+            *d++ = *s++;
+    } else {
+        d += n;
+        s += n;
+        if ((uintptr_t)d % WORD_SIZE == (uintptr_t)s % WORD_SIZE) {
+            for (; n > 0 && (uintptr_t)d % WORD_SIZE; n--)
+                *--d = *--s;
+            for (wd = (word_t *)d, ws = (const word_t *)s; n >= WORD_SIZE; n -= WORD_SIZE)
+                *--wd = *--ws;
+            d = (unsigned char *)wd;
+            s = (const unsigned char *)ws;
+        }
+        while (n--)
+            *--d = *--s;
+    }
+    return dest;
+}
+
+// Value of c as a digit in bases up to 36, 36 if it isn't one
+static unsigned digit_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 10;
+    return 36;
+}
+
+// Skip the spaces, sign and base prefix in front of the digits
+static const char * parse_prefix(const char * s, int * base, int * negative) {
+    while (*s == ' ' || *s == '\t')
+        s++;
+    *negative = *s == '-';
+    if (*s == '-' || *s == '+')
+        s++;
+
+    // Only take a prefix with a digit after it, "0x" on its own is a 0 followed by an x
+    if (s[0] == '0' && (s[1] | 0x20) == 'x' && (*base == 0 || *base == 16) && digit_value(s[2]) < 16) {
+        *base = 16;
+        s += 2;
+    } else if (s[0] == '0' && (s[1] | 0x20) == 'b' && (*base == 0 || *base == 2) && digit_value(s[2]) < 2) {
+        *base = 2;
+        s += 2;
+    } else if (*base == 0) {
+        *base = s[0] == '0' ? 8 : 10;
+    }
+    return s;
+}
+
+// Parse digits up to max.  The limit is worked out once, so the loop needs no division.
+// Digits past an overflow are still consumed, so end is past the whole number either way
+static const char * parse_u32(const char * s, unsigned base, uint32_t max, uint32_t * value, int * ok) {
+    uint32_t acc = 0, cutoff = max / base, cutlim = max % base;
+    const char * start = s;
+    unsigned d;
+
+    *ok = 1;
+    while ((d = digit_value(*s)) < base) {
+        if (acc > cutoff || (acc == cutoff && d > cutlim))
+            *ok = 0;
+        else
+            acc = acc * base + d;
+        s++;
+    }
+    if (s == start)
+        *ok = 0;
+    *value = acc;
+    return s;
+}
+
+static const char * parse_u64(const char * s, unsigned base, uint64_t max, uint64_t * value, int * ok) {
+    uint64_t acc = 0, cutoff = max / base;
+    uint32_t cutlim = max % base;
+    const char * start = s;
+    unsigned d;
+
+    *ok = 1;
+    while ((d = digit_value(*s)) < base) {
+        if (acc > cutoff || (acc == cutoff && d > cutlim))
+            *ok = 0;
+        else
+            acc = acc * base + d;
+        s++;
+    }
+    if (s == start)
+        *ok = 0;
+    *value = acc;
+    return s;
+}
+
+// Where end goes: past the number, or back at the start if there were no digits
+static void parse_end(const char * s, const char * digits, const char * after, char ** end) {
+    if (end != NULL)
+        *end = (char *)(after == digits ? s : after);
+}
+
+int strtol32(const char * s, char ** end, int base, int32_t * value) {
+    const char * digits, * after;
+    uint32_t acc;
+    int negative, ok;
+
+    if (base < 0 || base == 1 || base > 36) {
+        parse_end(s, s, s, end);
+        return -1;
+    }
+    digits = parse_prefix(s, &base, &negative);
+    after = parse_u32(digits, base, negative ? (uint32_t)INT32_MAX + 1 : INT32_MAX, &acc, &ok);
+    parse_end(s, digits, after, end);
+    if (!ok)
+        return -1;
+    *value = negative ? (int32_t)(0 - acc) : (int32_t)acc;
+    return 0;
+}
+
+int strtoul32(const char * s, char ** end, int base, uint32_t * value) {
+    const char * digits, * after;
+    uint32_t acc;
+    int negative, ok;
+
+    if (base < 0 || base == 1 || base > 36) {
+        parse_end(s, s, s, end);
+        return -1;
+    }
+    digits = parse_prefix(s, &base, &negative);
+    after = parse_u32(digits, base, UINT32_MAX, &acc, &ok);
+    parse_end(s, digits, after, end);
+    // No quietly wrapping -1 around to UINT32_MAX
+    if (!ok || negative)
+        return -1;
+    *value = acc;
+    return 0;
+}
+
+int strtol64(const char * s, char ** end, int base, int64_t * value) {
+    const char * digits, * after;
+    uint64_t acc;
+    int negative, ok;
+
+    if (base < 0 || base == 1 || base > 36) {
+        parse_end(s, s, s, end);
+        return -1;
+    }
+    digits = parse_prefix(s, &base, &negative);
+    after = parse_u64(digits, base, negative ? (uint64_t)INT64_MAX + 1 : INT64_MAX, &acc, &ok);
+    parse_end(s, digits, after, end);
+    if (!ok)
+        return -1;
+    *value = negative ? (int64_t)(0 - acc) : (int64_t)acc;
+    return 0;
+}
+
+int strtoul64(const char * s, char ** end, int base, uint64_t * value) {
+    const char * digits, * after;
+    uint64_t acc;
+    int negative, ok;
+
+    if (base < 0 || base == 1 || base > 36) {
+        parse_end(s, s, s, end);
+        return -1;
+    }
+    digits = parse_prefix(s, &base, &negative);
+    after = parse_u64(digits, base, UINT64_MAX, &acc, &ok);
+    parse_end(s, digits, after, end);
+    if (!ok || negative)
+        return -1;
+    *value = acc;
+    return 0;
+}
+
+// "00" to "99", so each division makes two digits
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint32_t powers_of_10[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+// v / 100 for any 32 bit v: multiply by 2^37 / 100 rounded up, keep the top bits
+#define DIV100(v) ((uint32_t)(((uint64_t)(v) * 0x51EB851F) >> 37))
+
+static int count_digits(uint32_t v) {
+    int t;
+
+    if (v < 10)
+        return 1;
+    // log10(v) from log2(v): 1233 / 4096 is just over log10(2), then correct by one
+    t = ((32 - __builtin_clz(v)) * 1233) >> 12;
+    return t + (v >= powers_of_10[t]);
+}
+
+// Write v's digits so the last lands just before end
+static void put_digits(uint32_t v, char * end) {
+    const char * pair;
+    uint32_t q;
+
+    while (v >= 100) {
+        q = DIV100(v);
+        pair = &digit_pairs[(v - q * 100) * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+        v = q;
+    }
+    if (v >= 10) {
+        *--end = digit_pairs[v * 2 + 1];
+        *--end = digit_pairs[v * 2];
+    } else {
+        *--end = '0' + v;
+    }
+}
+
+// Exactly 8 digits with leading zeros, for the low parts of a 64 bit number
+static void put_digits8(uint32_t v, char * end) {
+    const char * pair;
+    uint32_t q;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        q = DIV100(v);
+        pair = &digit_pairs[(v - q * 100) * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+        v = q;
+    }
+}
+
+int utoa_r(uint32_t value, char * buf) {
+    int len = count_digits(value);
+
+    put_digits(value, buf + len);
+    buf[len] = '\0';
+    return len;
+}
+
+int itoa_r(int32_t value, char * buf) {
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + utoa_r(0 - (uint32_t)value, buf + 1);
+    }
+    return utoa_r(value, buf);
+}
+
+int utoa64_r(uint64_t value, char * buf) {
+    uint32_t parts[2];
+    int count = 0, len;
+
+    // Split into 8 digit parts until the rest fits in 32 bits, which takes at most two 64 bit
+    // divisions.  Everything after that is 32 bit
+    while (value > UINT32_MAX) {
+        parts[count++] = value % 100000000;
+        value /= 100000000;
+    }
+    len = utoa_r(value, buf);
+    while (count--) {
+        put_digits8(parts[count], buf + len + 8);
+        len += 8;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+int itoa64_r(int64_t value, char * buf) {
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + utoa64_r(0 - (uint64_t)value, buf + 1);
+    }
+    return utoa64_r(value, buf);
+}
@@ -0,0 +1,42 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/uart.h>
+
+// Memory-Mapped I/O output.  Peripherals live below 4GB, so the register
+// addresses still fit in 32 bits and only need widening to a pointer
+void mmio_write(uint32_t reg, uint32_t data)
+{
+    *(volatile uint32_t*)(uintptr_t)reg = data;
+}
+
+// Memory-Mapped I/O input
+uint32_t mmio_read(uint32_t reg)
+{
+    return *(volatile uint32_t*)(uintptr_t)reg;
+}
+
+// Loop <delay> times in a way that the compiler won't optimize away
+void delay(int32_t count)
+{
+    asm volatile("__delay_%=: subs %w[count], %w[count], #1; bne __delay_%=\n"
+            : "=r"(count): [count]"0"(count) : "cc");
+}
+
+void cpu_cycles_init(void)
+{
+    uint64_t pmcr;
+
+    // PMCR_EL0: enable, reset the cycle counter.  Then enable the cycle counter in PMCNTENSET_EL0
+    asm volatile("mrs %0, pmcr_el0" : "=r"(pmcr));
+    asm volatile("msr pmcr_el0, %0" :: "r"(pmcr | (1 << 0) | (1 << 2)));
+    asm volatile("msr pmcntenset_el0, %0" :: "r"((uint64_t)1 << 31));
+    asm volatile("isb");
+}
+
+extern char exception_vector[];
+
+void cpu_vectors_init(void)
+{
+    asm volatile("msr vbar_el1, %0\n isb" :: "r"(exception_vector) : "memory");
+}
@@ -0,0 +1,117 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/mmu.h>
+
+// No VMSAv8 tables yet, so the MMU stays off and every address is physical.  The TLB and ASID
+// helpers are real, ready for when there are
+
+int mmu_init(uint32_t ram_size)
+{
+    (void) ram_size;
+    return -1;
+}
+
+int mmu_enabled(void)
+{
+    return 0;
+}
+
+int mmu_map(uintptr_t va, uintptr_t pa, uint32_t size, mmu_memory_t type)
+{
+    (void) va;
+    (void) pa;
+    (void) size;
+    (void) type;
+    return -1;
+}
+
+void mmu_unmap(uintptr_t va, uint32_t size)
+{
+    (void) va;
+    (void) size;
+}
+
+int mmu_lookup(uintptr_t va, uintptr_t * pa, uint32_t * size)
+{
+    (void) va;
+    (void) pa;
+    (void) size;
+    return -1;
+}
+
+int mmu_range_free(uintptr_t va, uint32_t size)
+{
+    (void) va;
+    (void) size;
+    return 1;
+}
+
+int mmu_set_user_access(uintptr_t va, uint32_t size, mmu_user_access_t access)
+{
+    (void) va;
+    (void) size;
+    (void) access;
+    return -1;
+}
+
+int mmu_translation_fault(uintptr_t * addr)
+{
+    (void) addr;
+    return 0;
+}
+
+// The data cache is off with the MMU
+void dcache_clean(const void * addr, uint32_t size)
+{
+    (void) addr;
+    (void) size;
+}
+
+void dcache_invalidate(const void * addr, uint32_t size)
+{
+    (void) addr;
+    (void) size;
+}
+
+void dcache_clean_invalidate(const void * addr, uint32_t size)
+{
+    (void) addr;
+    (void) size;
+}
+
+void dcache_clean_all(void)
+{
+}
+
+void tlb_flush_all(void)
+{
+    asm volatile("dsb ishst\n tlbi vmalle1is\n dsb ish\n isb" ::: "memory");
+}
+
+void tlb_flush_page(uintptr_t va)
+{
+    asm volatile("dsb ishst\n tlbi vaae1is, %0\n dsb ish\n isb" :: "r"(va >> 12) : "memory");
+}
+
+void tlb_flush_asid(uint32_t asid)
+{
+    asm volatile("dsb ishst\n tlbi aside1is, %0\n dsb ish\n isb" :: "r"((uint64_t)(asid & 0xFF) << 48) : "memory");
+}
+
+// The ASID lives in the top 16 bits of TTBR0_EL1, 8 of them used with TCR_EL1.AS clear
+void mmu_set_asid(uint32_t asid)
+{
+    uint64_t ttbr0;
+
+    asm volatile("mrs %0, ttbr0_el1" : "=r"(ttbr0));
+    ttbr0 = (ttbr0 & 0x0000FFFFFFFFFFFF) | ((uint64_t)(asid & 0xFF) << 48);
+    asm volatile("msr ttbr0_el1, %0\n isb" :: "r"(ttbr0) : "memory");
+}
+
+uint32_t mmu_get_asid(void)
+{
+    uint64_t ttbr0;
+
+    asm volatile("mrs %0, ttbr0_el1" : "=r"(ttbr0));
+    return (ttbr0 >> 48) & 0xFF;
+}
@@ -0,0 +1,63 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/mmu.h>
+#include <kernel/uart.h>
+
+// Memory-Mapped I/O output
+void mmio_write(uint32_t reg, uint32_t data)
+{
+    *(volatile uint32_t*)reg = data;
+}
+
+// Memory-Mapped I/O input
+uint32_t mmio_read(uint32_t reg)
+{
+    return *(volatile uint32_t*)reg;
+}
+
+// Loop <delay> times in a way that the compiler won't optimize away
+void delay(int32_t count)
+{
+    asm volatile("__delay_%=: subs %[count], %[count], #1; bne __delay_%=\n"
+            : "=r"(count): [count]"0"(count) : "cc");
+}
+
+void cpu_cycles_init(void)
+{
+#ifdef MODEL_1
+    // ARM11 performance monitor control: enable, reset the cycle counter
+    asm volatile("mcr p15, 0, %0, c15, c12, 0" :: "r"((1 << 0) | (1 << 2)));
+#else
+    // PMCR: enable, reset the cycle counter.  Then enable the cycle counter in PMCNTENSET
+    uint32_t pmcr;
+    asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r"(pmcr));
+    asm volatile("mcr p15, 0, %0, c9, c12, 0" :: "r"(pmcr | (1 << 0) | (1 << 2)));
+    asm volatile("mcr p15, 0, %0, c9, c12, 1" :: "r"(1 << 31));
+#endif
+}
+
+extern uint32_t exception_vector[];
+extern uint32_t exception_vector_end[];
+
+void cpu_vectors_init(void)
+{
+    // The model 1 has no VBAR, so do it the portable way: the table and the addresses it loads
+    // are position independent relative to each other, copy the lot to the low vectors at 0
+    volatile uint32_t * vectors, * dest;
+    uint32_t * src;
+
+    // Stores through a null pointer are undefined to the compiler, so hide where dest points
+    asm("" : "=r"(vectors) : "0"(0));
+
+    dest = vectors;
+    for (src = exception_vector; src < exception_vector_end; src++)
+        *dest++ = *src;
+    // With the data cache on the copy may still be in it, where instruction fetches don't look
+    dcache_clean((const void *)vectors, (uintptr_t)dest - (uintptr_t)vectors);
+#ifdef MODEL_1
+    asm volatile("mcr p15, 0, %0, c7, c5, 0" :: "r"(0) : "memory");
+#else
+    asm volatile("dsb\n mcr p15, 0, %0, c7, c5, 0\n isb" :: "r"(0) : "memory");
+#endif
+}
@@ -0,0 +1,515 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/atomic.h>
+#include <kernel/mem.h>
+#include <kernel/mmu.h>
+#include <kernel/peripheral.h>
+
+#define L1_ENTRIES 4096
+#define L2_ENTRIES 256
+#define L2_TABLE_SIZE (L2_ENTRIES * sizeof(uint32_t))
+#define L1_INDEX(va) ((va) >> 20)
+#define L2_INDEX(va) (((va) >> 12) & (L2_ENTRIES - 1))
+
+// First level descriptors
+#define L1_TYPE_MASK 0x3
+#define L1_FAULT 0x0
+#define L1_TABLE 0x1
+#define L1_SECTION 0x2
+#define L1_TABLE_BASE(desc) ((desc) & ~0x3FF)
+#define L1_SECTION_BASE(desc) ((desc) & ~(SECTION_SIZE - 1))
+
+// Second level descriptors.  Bit 1 set is a small page, where bit 0 is XN
+#define L2_FAULT 0x0
+#define L2_LARGE 0x1
+#define L2_SMALL 0x2
+#define L2_LARGE_BASE(desc) ((desc) & ~(LARGE_PAGE_SIZE - 1))
+#define L2_SMALL_BASE(desc) ((desc) & ~(PAGE_SIZE - 1))
+#define L2_AP(desc) (((desc) >> 4) & 0x3)
+#define LARGE_PAGE_ENTRIES (LARGE_PAGE_SIZE / PAGE_SIZE)
+
+// Access permissions, AP[2] clear
+#define AP_KERNEL 0x1       // Read/write for the kernel, nothing for user mode
+#define AP_USER_READ 0x2    // Read/write for the kernel, read only for user mode
+#define AP_FULL 0x3         // Read/write for both
+
+// Where each field sits in the three descriptor formats
+#define SECTION_ATTRS(tex, cb, ap, s, xn) \
+    (((tex) << 12) | ((cb) << 2) | ((ap) << 10) | ((s) << 16) | ((xn) << 4))
+#define LARGE_ATTRS(tex, cb, ap, s, xn) \
+    (((tex) << 12) | ((cb) << 2) | ((ap) << 4) | ((s) << 10) | ((xn) << 15))
+#define SMALL_ATTRS(tex, cb, ap, s, xn) \
+    (((tex) << 6) | ((cb) << 2) | ((ap) << 4) | ((s) << 10) | (xn))
+
+// TEX, C and B for each mmu_memory_t, with TEX remap off.  Normal memory is write back write
+// allocate
+static const struct {
+    uint8_t tex, cb, shared, xn;
+} memory_types[] = {
+    [MMU_NORMAL] = { 0x1, 0x3, 1, 0 },
+    [MMU_UNCACHED] = { 0x1, 0x0, 1, 0 },
+    [MMU_DEVICE] = { 0x0, 0x1, 0, 1 },      // Shareable device
+};
+
+#define SCTLR_M (1 << 0)
+#define SCTLR_C (1 << 2)
+#define SCTLR_XP (1 << 23)  // ARMv6 format without subpages.  Always set on ARMv7
+#define DACR_CLIENT(domain) (1 << ((domain) * 2))
+
+// Data fault status: translation faults on a section or a page
+#define DFSR_STATUS(dfsr) (((dfsr) & 0xF) | (((dfsr) >> 6) & 0x10))
+#define DFSR_TRANSLATION_SECTION 0x5
+#define DFSR_TRANSLATION_PAGE 0x7
+
+static uint32_t l1_table[L1_ENTRIES] __attribute__((aligned(16384)));
+// Entries in use in the second level table under each first level entry
+static uint16_t l2_used[L1_ENTRIES];
+// Free second level tables, four to a page, linked through their first entry
+static uint32_t * l2_free;
+static int mmu_on;
+static uint32_t mmu_ram_size;
+
+static void dcache_invalidate_all(void);
+
+// The mailbox and the GPU sit outside the inner shareable domain dsb() waits for
+static inline void dsb_sy(void)
+{
+#ifdef MODEL_1
+    dsb();
+#else
+    asm volatile("dsb sy" ::: "memory");
+#endif
+}
+
+// Table walks don't look in the data cache, so push descriptors written through it out to memory
+static void pte_sync(const uint32_t * entry, uint32_t count)
+{
+    uintptr_t line = (uintptr_t)entry & ~(CACHE_LINE_SIZE - 1);
+
+    for (; line < (uintptr_t)(entry + count); line += CACHE_LINE_SIZE)
+        asm volatile("mcr p15, 0, %0, c7, c10, 1" :: "r"(line) : "memory");
+    dsb();
+}
+
+static uint32_t section_desc(uintptr_t pa, mmu_memory_t type, uint32_t ap)
+{
+    return pa | L1_SECTION | SECTION_ATTRS(memory_types[type].tex, memory_types[type].cb, ap,
+            memory_types[type].shared, memory_types[type].xn);
+}
+
+// A large or small page descriptor
+static uint32_t l2_desc(uintptr_t pa, uint32_t size, mmu_memory_t type, uint32_t ap)
+{
+    if (size == LARGE_PAGE_SIZE)
+        return pa | L2_LARGE | LARGE_ATTRS(memory_types[type].tex, memory_types[type].cb, ap,
+                memory_types[type].shared, memory_types[type].xn);
+    return pa | L2_SMALL | SMALL_ATTRS(memory_types[type].tex, memory_types[type].cb, ap,
+            memory_types[type].shared, memory_types[type].xn);
+}
+
+static void l2_release(uint32_t * table)
+{
+    table[0] = (uint32_t)l2_free;
+    l2_free = table;
+}
+
+// A zeroed second level table.  Page table memory is identity mapped, so the table's address is
+// also what goes in the first level descriptor
+static uint32_t * l2_alloc(void)
+{
+    uint8_t * page;
+    uint32_t * table;
+    uint32_t i;
+
+    if (l2_free == NULL) {
+        if ((page = alloc_page()) == NULL)
+            return NULL;
+        for (i = 0; i < PAGE_SIZE / L2_TABLE_SIZE; i++)
+            l2_release((uint32_t *)(page + i * L2_TABLE_SIZE));
+    }
+    table = l2_free;
+    l2_free = (uint32_t *)table[0];
+    table[0] = L2_FAULT;
+    return table;
+}
+
+// The second level table for va, made if there isn't one.  NULL if a section is in the way
+static uint32_t * l2_get(uintptr_t va)
+{
+    uint32_t desc = l1_table[L1_INDEX(va)];
+    uint32_t * table;
+
+    if ((desc & L1_TYPE_MASK) == L1_TABLE)
+        return (uint32_t *)L1_TABLE_BASE(desc);
+    if ((desc & L1_TYPE_MASK) != L1_FAULT || (table = l2_alloc()) == NULL)
+        return NULL;
+    pte_sync(table, L2_ENTRIES);
+    l1_table[L1_INDEX(va)] = (uint32_t)table | L1_TABLE;   // Domain 0
+    pte_sync(&l1_table[L1_INDEX(va)], 1);
+    return table;
+}
+
+int mmu_init(uint32_t ram_size)
+{
+    uint32_t i, addr, sctlr;
+
+    mmu_ram_size = ram_size;
+    for (i = 0; i < L1_ENTRIES; i++) {
+        addr = i * SECTION_SIZE;
+        if (addr < ram_size)
+            l1_table[i] = section_desc(addr, MMU_NORMAL, AP_KERNEL);
+        else if (addr < PERIPHERAL_BASE)
+            l1_table[i] = section_desc(addr, MMU_UNCACHED, AP_KERNEL);
+        else if (addr < PERIPHERAL_BASE + 16 * SECTION_SIZE)
+            l1_table[i] = section_desc(addr, MMU_DEVICE, AP_KERNEL);
+        else
+            break;
+    }
+
+    // Nothing a previous kernel left in the cache may be written back over us once it is on
+    dcache_invalidate_all();
+    tlb_flush_all();
+    asm volatile("mcr p15, 0, %0, c3, c0, 0" :: "r"(DACR_CLIENT(0)));   // Check domain 0's AP bits
+    asm volatile("mcr p15, 0, %0, c2, c0, 2" :: "r"(0));                // TTBCR: TTBR0 for all of it
+    asm volatile("mcr p15, 0, %0, c2, c0, 0" :: "r"(l1_table));         // Uncached table walks
+    mmu_set_asid(0);
+    dsb();
+    isb();
+
+    asm volatile("mrc p15, 0, %0, c1, c0, 0" : "=r"(sctlr));
+    sctlr |= SCTLR_M | SCTLR_C | SCTLR_XP;
+    asm volatile("mcr p15, 0, %0, c1, c0, 0" :: "r"(sctlr) : "memory");
+    isb();
+    mmu_on = 1;
+    return 0;
+}
+
+// Each data and unified cache level by set/way, up to the point of coherency.  The model 1 has
+// one level and operations on all of it.  op is the CRm of the set/way operation: c6 invalidate,
+// c10 clean, c14 both
+#define DCACHE_INVALIDATE 6
+#define DCACHE_CLEAN 10
+#define DCACHE_CLEAN_INVALIDATE 14
+
+static void dcache_set_way(uint32_t op)
+{
+#ifdef MODEL_1
+    if (op == DCACHE_INVALIDATE)
+        asm volatile("mcr p15, 0, %0, c7, c6, 0" :: "r"(0) : "memory");
+    else if (op == DCACHE_CLEAN)
+        asm volatile("mcr p15, 0, %0, c7, c10, 0" :: "r"(0) : "memory");
+    else
+        asm volatile("mcr p15, 0, %0, c7, c14, 0" :: "r"(0) : "memory");
+#else
+    uint32_t clidr, ccsidr, level, ways, sets, line_shift, way_shift, way, set, sw;
+
+    asm volatile("mrc p15, 1, %0, c0, c0, 1" : "=r"(clidr));
+    for (level = 0; level < ((clidr >> 24) & 0x7); level++) {
+        // Instruction only or no cache at this level
+        if (((clidr >> (level * 3)) & 0x7) < 2)
+            continue;
+        asm volatile("mcr p15, 2, %0, c0, c0, 0" :: "r"(level << 1));    // CSSELR
+        isb();
+        asm volatile("mrc p15, 1, %0, c0, c0, 0" : "=r"(ccsidr));
+        line_shift = (ccsidr & 0x7) + 4;
+        ways = ((ccsidr >> 3) & 0x3FF) + 1;
+        sets = ((ccsidr >> 13) & 0x7FFF) + 1;
+        way_shift = ways > 1 ? __builtin_clz(ways - 1) : 0;
+        for (way = 0; way < ways; way++) {
+            for (set = 0; set < sets; set++) {
+                sw = (way << way_shift) | (set << line_shift) | (level << 1);
+                if (op == DCACHE_INVALIDATE)
+                    asm volatile("mcr p15, 0, %0, c7, c6, 2" :: "r"(sw) : "memory");
+                else if (op == DCACHE_CLEAN)
+                    asm volatile("mcr p15, 0, %0, c7, c10, 2" :: "r"(sw) : "memory");
+                else
+                    asm volatile("mcr p15, 0, %0, c7, c14, 2" :: "r"(sw) : "memory");
+            }
+        }
+    }
+#endif
+    dsb_sy();
+}
+
+// Only safe with the cache off: dirty lines are lost
+static void dcache_invalidate_all(void)
+{
+    dcache_set_way(DCACHE_INVALIDATE);
+}
+
+void dcache_clean_all(void)
+{
+    dcache_set_way(DCACHE_CLEAN);
+}
+
+void dcache_clean(const void * addr, uint32_t size)
+{
+    uintptr_t line = (uintptr_t)addr & ~(CACHE_LINE_SIZE - 1);
+
+    dsb_sy();
+    for (; line < (uintptr_t)addr + size; line += CACHE_LINE_SIZE)
+        asm volatile("mcr p15, 0, %0, c7, c10, 1" :: "r"(line) : "memory");
+    dsb_sy();
+}
+
+void dcache_invalidate(const void * addr, uint32_t size)
+{
+    uintptr_t line = (uintptr_t)addr & ~(CACHE_LINE_SIZE - 1);
+
+    for (; line < (uintptr_t)addr + size; line += CACHE_LINE_SIZE)
+        asm volatile("mcr p15, 0, %0, c7, c6, 1" :: "r"(line) : "memory");
+    dsb_sy();
+}
+
+void dcache_clean_invalidate(const void * addr, uint32_t size)
+{
+    uintptr_t line = (uintptr_t)addr & ~(CACHE_LINE_SIZE - 1);
+
+    dsb_sy();
+    for (; line < (uintptr_t)addr + size; line += CACHE_LINE_SIZE)
+        asm volatile("mcr p15, 0, %0, c7, c14, 1" :: "r"(line) : "memory");
+    dsb_sy();
+}
+
+int mmu_enabled(void)
+{
+    return mmu_on;
+}
+
+int mmu_map(uintptr_t va, uintptr_t pa, uint32_t size, mmu_memory_t type)
+{
+    uint32_t * table, desc, first, count, i;
+
+    if ((va | pa) & (size - 1))
+        return -1;
+    if (size == SECTION_SIZE) {
+        if (l1_table[L1_INDEX(va)] != L1_FAULT)
+            return -1;
+        l1_table[L1_INDEX(va)] = section_desc(pa, type, AP_KERNEL);
+        pte_sync(&l1_table[L1_INDEX(va)], 1);
+        return 0;
+    }
+    if (size != LARGE_PAGE_SIZE && size != PAGE_SIZE)
+        return -1;
+
+    if ((table = l2_get(va)) == NULL)
+        return -1;
+    first = L2_INDEX(va);
+    count = size / PAGE_SIZE;
+    for (i = 0; i < count; i++)
+        if (table[first + i] != L2_FAULT)
+            return -1;
+    desc = l2_desc(pa, size, type, AP_KERNEL);
+    // A large page is the same descriptor in all 16 of its entries
+    for (i = 0; i < count; i++)
+        table[first + i] = desc;
+    l2_used[L1_INDEX(va)] += count;
+    pte_sync(&table[first], count);
+    return 0;
+}
+
+void mmu_unmap(uintptr_t va, uint32_t size)
+{
+    uint32_t desc = l1_table[L1_INDEX(va)];
+    uint32_t * table, first, count, i;
+
+    if ((desc & L1_TYPE_MASK) == L1_SECTION) {
+        l1_table[L1_INDEX(va)] = L1_FAULT;
+        pte_sync(&l1_table[L1_INDEX(va)], 1);
+        tlb_flush_page(va);
+        return;
+    }
+    if ((desc & L1_TYPE_MASK) != L1_TABLE)
+        return;
+
+    table = (uint32_t *)L1_TABLE_BASE(desc);
+    first = L2_INDEX(va);
+    count = size / PAGE_SIZE;
+    for (i = 0; i < count; i++) {
+        if (table[first + i] != L2_FAULT) {
+            table[first + i] = L2_FAULT;
+            l2_used[L1_INDEX(va)]--;
+        }
+    }
+    pte_sync(&table[first], count);
+    if (l2_used[L1_INDEX(va)] == 0) {
+        l1_table[L1_INDEX(va)] = L1_FAULT;
+        pte_sync(&l1_table[L1_INDEX(va)], 1);
+    }
+    // Also drops any cached walk through the table, so it can be reused once this is done
+    tlb_flush_page(va);
+    if (l2_used[L1_INDEX(va)] == 0)
+        l2_release(table);
+}
+
+int mmu_lookup(uintptr_t va, uintptr_t * pa, uint32_t * size)
+{
+    uint32_t desc = l1_table[L1_INDEX(va)];
+
+    if ((desc & L1_TYPE_MASK) == L1_SECTION) {
+        *pa = L1_SECTION_BASE(desc) | (va & (SECTION_SIZE - 1));
+        *size = SECTION_SIZE;
+        return 0;
+    }
+    if ((desc & L1_TYPE_MASK) != L1_TABLE)
+        return -1;
+
+    desc = ((uint32_t *)L1_TABLE_BASE(desc))[L2_INDEX(va)];
+    if (desc & L2_SMALL) {
+        *pa = L2_SMALL_BASE(desc) | (va & (PAGE_SIZE - 1));
+        *size = PAGE_SIZE;
+    } else if (desc & L2_LARGE) {
+        *pa = L2_LARGE_BASE(desc) | (va & (LARGE_PAGE_SIZE - 1));
+        *size = LARGE_PAGE_SIZE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int mmu_range_free(uintptr_t va, uint32_t size)
+{
+    uint32_t desc = l1_table[L1_INDEX(va)];
+    uint32_t * table, first, i;
+
+    if ((desc & L1_TYPE_MASK) == L1_FAULT)
+        return 1;
+    if ((desc & L1_TYPE_MASK) != L1_TABLE || size >= SECTION_SIZE)
+        return 0;
+    table = (uint32_t *)L1_TABLE_BASE(desc);
+    first = L2_INDEX(va & ~(size - 1));
+    for (i = 0; i < size / PAGE_SIZE; i++)
+        if (table[first + i] != L2_FAULT)
+            return 0;
+    return 1;
+}
+
+// The second level table under the RAM section holding va, first turning the section into 16
+// large pages with its permissions.  NULL if there is no memory for the table
+static uint32_t * ram_split_section(uintptr_t va)
+{
+    uint32_t desc = l1_table[L1_INDEX(va)];
+    uint32_t * table, i;
+    uintptr_t base;
+
+    if ((desc & L1_TYPE_MASK) == L1_TABLE)
+        return (uint32_t *)L1_TABLE_BASE(desc);
+    if ((table = l2_alloc()) == NULL)
+        return NULL;
+    base = L1_SECTION_BASE(desc);
+    for (i = 0; i < L2_ENTRIES; i++)
+        table[i] = l2_desc(base + (i & ~(LARGE_PAGE_ENTRIES - 1)) * PAGE_SIZE, LARGE_PAGE_SIZE,
+                MMU_NORMAL, (desc >> 10) & 0x3);
+    l2_used[L1_INDEX(va)] = L2_ENTRIES;
+    pte_sync(table, L2_ENTRIES);
+    // Same addresses and permissions, so it doesn't matter which of the two the TLB holds until
+    // the flush
+    l1_table[L1_INDEX(va)] = (uint32_t)table | L1_TABLE;
+    pte_sync(&l1_table[L1_INDEX(va)], 1);
+    tlb_flush_page(va);
+    return table;
+}
+
+int mmu_set_user_access(uintptr_t va, uint32_t size, mmu_user_access_t access)
+{
+    uint32_t ap = access == MMU_USER_WRITE ? AP_FULL : access == MMU_USER_READ ? AP_USER_READ : AP_KERNEL;
+    uint32_t * table, first, i;
+    uintptr_t end = va + size, chunk, next, pa, page;
+
+    if ((va | size) & (PAGE_SIZE - 1) || end > mmu_ram_size || end < va)
+        return -1;
+    // A large page at a time, split into small pages when only part of it changes
+    for (; va < end; va = next) {
+        chunk = va & ~(LARGE_PAGE_SIZE - 1);
+        next = end - chunk < LARGE_PAGE_SIZE ? end : chunk + LARGE_PAGE_SIZE;
+        if ((table = ram_split_section(va)) == NULL)
+            return -1;
+        first = L2_INDEX(chunk);
+
+        if (!(table[first] & L2_SMALL) && va == chunk && next == chunk + LARGE_PAGE_SIZE) {
+            pa = L2_LARGE_BASE(table[first]);
+            for (i = 0; i < LARGE_PAGE_ENTRIES; i++)
+                table[first + i] = l2_desc(pa, LARGE_PAGE_SIZE, MMU_NORMAL, ap);
+            pte_sync(&table[first], LARGE_PAGE_ENTRIES);
+            tlb_flush_page(chunk);
+            continue;
+        }
+        if (!(table[first] & L2_SMALL)) {
+            pa = L2_LARGE_BASE(table[first]);
+            for (i = 0; i < LARGE_PAGE_ENTRIES; i++)
+                table[first + i] = l2_desc(pa + i * PAGE_SIZE, PAGE_SIZE, MMU_NORMAL, L2_AP(table[first + i]));
+        }
+        for (page = va; page < next; page += PAGE_SIZE)
+            table[L2_INDEX(page)] = l2_desc(L2_SMALL_BASE(table[L2_INDEX(page)]), PAGE_SIZE, MMU_NORMAL, ap);
+        pte_sync(&table[first], LARGE_PAGE_ENTRIES);
+        // Any page of the old large page drops its TLB entry along with the page's own
+        for (page = va; page < next; page += PAGE_SIZE)
+            tlb_flush_page(page);
+    }
+    return 0;
+}
+
+int mmu_translation_fault(uintptr_t * addr)
+{
+    uint32_t dfsr, dfar, status;
+
+    asm volatile("mrc p15, 0, %0, c5, c0, 0" : "=r"(dfsr));
+    asm volatile("mrc p15, 0, %0, c6, c0, 0" : "=r"(dfar));
+    status = DFSR_STATUS(dfsr);
+    *addr = dfar;
+    return status == DFSR_TRANSLATION_SECTION || status == DFSR_TRANSLATION_PAGE;
+}
+
+// The model 1 only has the local TLB operations.  ARMv7 broadcasts to the inner shareable
+// domain, which is every core
+void tlb_flush_all(void)
+{
+    dsb();
+#ifdef MODEL_1
+    asm volatile("mcr p15, 0, %0, c8, c7, 0" :: "r"(0) : "memory");
+#else
+    asm volatile("mcr p15, 0, %0, c8, c3, 0" :: "r"(0) : "memory");
+#endif
+    dsb();
+    isb();
+}
+
+void tlb_flush_page(uintptr_t va)
+{
+    dsb();
+#ifdef MODEL_1
+    // By MVA also matches global entries whatever the ASID
+    asm volatile("mcr p15, 0, %0, c8, c7, 1" :: "r"((va & ~(PAGE_SIZE - 1)) | mmu_get_asid()) : "memory");
+#else
+    asm volatile("mcr p15, 0, %0, c8, c3, 3" :: "r"(va & ~(PAGE_SIZE - 1)) : "memory");
+#endif
+    dsb();
+    isb();
+}
+
+void tlb_flush_asid(uint32_t asid)
+{
+    dsb();
+#ifdef MODEL_1
+    asm volatile("mcr p15, 0, %0, c8, c7, 2" :: "r"(asid & 0xFF) : "memory");
+#else
+    asm volatile("mcr p15, 0, %0, c8, c3, 2" :: "r"(asid & 0xFF) : "memory");
+#endif
+    dsb();
+    isb();
+}
+
+void mmu_set_asid(uint32_t asid)
+{
+    // CONTEXTIDR: the ASID is the low byte, the rest is a process id only debuggers look at
+    asm volatile("mcr p15, 0, %0, c13, c0, 1" :: "r"(asid & 0xFF) : "memory");
+    isb();
+}
+
+uint32_t mmu_get_asid(void)
+{
+    uint32_t contextidr;
+
+    asm volatile("mrc p15, 0, %0, c13, c0, 1" : "=r"(contextidr));
+    return contextidr & 0xFF;
+}
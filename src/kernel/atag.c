@@ -1,6 +1,10 @@
+#include <stddef.h>
 #include <kernel/atag.h>
 
 uint32_t get_mem_size(atag_t * tag) {
+   // The 64 bit boot path hands us a device tree instead of ATAGS
+   if (tag == NULL)
+       return 0;
    while (tag->tag != NONE) {
        if (tag->tag == MEM) {
            return tag->mem.size;
@@ -10,3 +14,15 @@ uint32_t get_mem_size(atag_t * tag) {
    return 0;
 
 }
+
+initrd2_t * get_initrd(atag_t * tag) {
+   if (tag == NULL)
+       return NULL;
+   while (tag->tag != NONE) {
+       if (tag->tag == INITRD2 && tag->initrd2.size != 0) {
+           return &tag->initrd2;
+       }
+       tag = (atag_t *)(((uint32_t *)tag) + tag->tag_size);
+   }
+   return NULL;
+}
@@ -0,0 +1,290 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/bcache.h>
+#include <kernel/emmc.h>
+#include <kernel/list.h>
+#include <kernel/mem.h>
+#include <common/stdlib.h>
+
+/**
+ * A buffer caches one page worth of the card.  Buffers live on an LRU list, most recently used
+ * at the head, and are found through a hash of the buffer number.
+ */
+typedef struct bcache_buf {
+    uint32_t buffer;            // Card block / BCACHE_BLOCKS_PER_BUFFER
+    uint8_t valid: 1;           // data holds the card contents
+    uint8_t dirty: 1;           // data is newer than the card
+    uint8_t readahead: 1;       // Read ahead and not used yet
+    uint8_t * data;
+    struct bcache_buf * hash_next;
+    DEFINE_LINK(bcache_buf);
+} bcache_buf_t;
+
+DEFINE_LIST(bcache_buf);
+IMPLEMENT_LIST(bcache_buf);
+
+static bcache_buf_t * bcache_bufs;
+// BCACHE_READAHEAD contiguous buffers, so a run of read ahead misses is one multi block read
+static uint8_t * bcache_staging;
+static bcache_buf_t * bcache_hash[BCACHE_HASH_SIZE];
+static bcache_buf_list_t bcache_lru;
+static bcache_stats_t bcache_stats;
+static uint32_t bcache_last_buffer = 0xFFFFFFFF;
+static int bcache_initialized;
+
+#define BCACHE_HASH(buffer) ((buffer) & (BCACHE_HASH_SIZE - 1))
+
+int bcache_init(void) {
+    uint32_t i;
+
+    if (emmc_init() != 0)
+        return -1;
+
+    if (!bcache_bufs) {
+        bcache_bufs = kmalloc(sizeof(bcache_buf_t) * BCACHE_NUM_BUFFERS);
+        if (!bcache_bufs)
+            return -1;
+        bzero(bcache_bufs, sizeof(bcache_buf_t) * BCACHE_NUM_BUFFERS);
+        INITIALIZE_LIST(bcache_lru);
+
+        for (i = 0; i < BCACHE_NUM_BUFFERS; i++) {
+            bcache_bufs[i].data = alloc_page();
+            if (!bcache_bufs[i].data)
+                break;
+            append_bcache_buf_list(&bcache_lru, &bcache_bufs[i]);
+        }
+        if (size_bcache_buf_list(&bcache_lru) == 0)
+            return -1;
+        // Without it read ahead goes a buffer at a time
+        bcache_staging = alloc_pages(BCACHE_READAHEAD * BCACHE_BUFFER_SIZE / PAGE_SIZE);
+    }
+
+    bcache_initialized = 1;
+    return 0;
+}
+
+int bcache_ready(void) {
+    return bcache_initialized;
+}
+
+static bcache_buf_t * bcache_lookup(uint32_t buffer) {
+    bcache_buf_t * buf;
+
+    for (buf = bcache_hash[BCACHE_HASH(buffer)]; buf != NULL; buf = buf->hash_next) {
+        if (buf->buffer == buffer)
+            return buf;
+    }
+    return NULL;
+}
+
+static void bcache_hash_remove(bcache_buf_t * buf) {
+    bcache_buf_t ** link = &bcache_hash[BCACHE_HASH(buf->buffer)];
+
+    while (*link != NULL && *link != buf)
+        link = &(*link)->hash_next;
+    if (*link != NULL)
+        *link = buf->hash_next;
+    buf->hash_next = NULL;
+}
+
+static void bcache_hash_insert(bcache_buf_t * buf) {
+    buf->hash_next = bcache_hash[BCACHE_HASH(buf->buffer)];
+    bcache_hash[BCACHE_HASH(buf->buffer)] = buf;
+}
+
+static int bcache_writeback(bcache_buf_t * buf) {
+    if (!buf->valid || !buf->dirty)
+        return 0;
+    if (emmc_write_blocks(buf->buffer * BCACHE_BLOCKS_PER_BUFFER, BCACHE_BLOCKS_PER_BUFFER, buf->data) != 0)
+        return -1;
+    buf->dirty = 0;
+    bcache_stats.writebacks++;
+    return 0;
+}
+
+// Take the least recently used buffer, writing it back first if it is dirty
+static bcache_buf_t * bcache_evict(void) {
+    bcache_buf_t * buf = bcache_lru.tail;
+
+    if (bcache_writeback(buf) != 0)
+        return NULL;
+    if (buf->valid)
+        bcache_hash_remove(buf);
+    buf->valid = 0;
+    buf->readahead = 0;
+    return buf;
+}
+
+// Bring a buffer into the cache, reading it from the card if fill is set.  Leaves it at the
+// head of the LRU list
+static bcache_buf_t * bcache_load(uint32_t buffer, int fill) {
+    bcache_buf_t * buf = bcache_evict();
+
+    if (buf == NULL)
+        return NULL;
+    if (fill && emmc_read_blocks(buffer * BCACHE_BLOCKS_PER_BUFFER, BCACHE_BLOCKS_PER_BUFFER, buf->data) != 0)
+        return NULL;
+
+    buf->buffer = buffer;
+    buf->valid = 1;
+    bcache_hash_insert(buf);
+    remove_bcache_buf_list(&bcache_lru, buf);
+    push_bcache_buf_list(&bcache_lru, buf);
+    return buf;
+}
+
+// Read count buffers from first that aren't cached with one command, through the staging area.
+// Returns -1 if the card couldn't read them
+static int bcache_readahead_run(uint32_t first, uint32_t count) {
+    bcache_buf_t * buf;
+    uint32_t i;
+
+    if (bcache_staging != NULL) {
+        if (emmc_read_blocks(first * BCACHE_BLOCKS_PER_BUFFER, count * BCACHE_BLOCKS_PER_BUFFER, bcache_staging) != 0)
+            return -1;
+    }
+    for (i = 0; i < count; i++) {
+        buf = bcache_load(first + i, bcache_staging == NULL);
+        if (buf == NULL)
+            return -1;
+        if (bcache_staging != NULL)
+            memcpy(buf->data, bcache_staging + i * BCACHE_BUFFER_SIZE, BCACHE_BUFFER_SIZE);
+        buf->readahead = 1;
+        bcache_stats.readaheads++;
+    }
+    return 0;
+}
+
+// Keep the next BCACHE_READAHEAD buffers after a sequential access in the cache.  Prefetched
+// buffers go to the head of the LRU list so they survive until the reader gets to them
+static void bcache_readahead(uint32_t buffer) {
+    uint32_t i, first = 0, count = 0;
+
+    for (i = 1; i <= BCACHE_READAHEAD + 1; i++) {
+        if (i <= BCACHE_READAHEAD && bcache_lookup(buffer + i) == NULL) {
+            if (count++ == 0)
+                first = buffer + i;
+            continue;
+        }
+        // Most likely the end of the card, don't try any further
+        if (count > 0 && bcache_readahead_run(first, count) != 0)
+            return;
+        count = 0;
+    }
+}
+
+static bcache_buf_t * bcache_get(uint32_t buffer, int fill) {
+    bcache_buf_t * buf = bcache_lookup(buffer);
+
+    if (buf != NULL) {
+        bcache_stats.hits++;
+        if (buf->readahead) {
+            bcache_stats.readahead_hits++;
+            buf->readahead = 0;
+        }
+        remove_bcache_buf_list(&bcache_lru, buf);
+        push_bcache_buf_list(&bcache_lru, buf);
+    } else {
+        bcache_stats.misses++;
+        buf = bcache_load(buffer, fill);
+        if (buf == NULL)
+            return NULL;
+    }
+
+    if (buffer == bcache_last_buffer + 1)
+        bcache_readahead(buffer);
+    bcache_last_buffer = buffer;
+
+    // Read ahead may have pushed other buffers in front, move this one back to the head
+    remove_bcache_buf_list(&bcache_lru, buf);
+    push_bcache_buf_list(&bcache_lru, buf);
+    return buf;
+}
+
+int bcache_read(uint32_t lba, uint32_t count, void * dest) {
+    bcache_buf_t * buf;
+    uint32_t offset, n;
+    uint8_t * d = dest;
+
+    if (!bcache_initialized)
+        return -1;
+
+    while (count > 0) {
+        offset = lba % BCACHE_BLOCKS_PER_BUFFER;
+        n = BCACHE_BLOCKS_PER_BUFFER - offset;
+        if (n > count)
+            n = count;
+
+        buf = bcache_get(lba / BCACHE_BLOCKS_PER_BUFFER, 1);
+        if (buf == NULL)
+            return -1;
+        memcpy(d, buf->data + offset * EMMC_BLOCK_SIZE, n * EMMC_BLOCK_SIZE);
+
+        d += n * EMMC_BLOCK_SIZE;
+        lba += n;
+        count -= n;
+    }
+    return 0;
+}
+
+int bcache_write(uint32_t lba, uint32_t count, const void * src) {
+    bcache_buf_t * buf;
+    uint32_t offset, n;
+    const uint8_t * s = src;
+
+    if (!bcache_initialized)
+        return -1;
+
+    while (count > 0) {
+        offset = lba % BCACHE_BLOCKS_PER_BUFFER;
+        n = BCACHE_BLOCKS_PER_BUFFER - offset;
+        if (n > count)
+            n = count;
+
+        // A write covering the whole buffer doesn't need the old contents
+        buf = bcache_get(lba / BCACHE_BLOCKS_PER_BUFFER, n != BCACHE_BLOCKS_PER_BUFFER);
+        if (buf == NULL)
+            return -1;
+        memcpy(buf->data + offset * EMMC_BLOCK_SIZE, (void *)s, n * EMMC_BLOCK_SIZE);
+        buf->dirty = 1;
+
+        s += n * EMMC_BLOCK_SIZE;
+        lba += n;
+        count -= n;
+    }
+    return 0;
+}
+
+int bcache_sync(void) {
+    bcache_buf_t * buf;
+    int res = 0;
+
+    for (buf = bcache_lru.head; buf != NULL; buf = next_bcache_buf_list(buf)) {
+        if (bcache_writeback(buf) != 0)
+            res = -1;
+    }
+    return res;
+}
+
+int bcache_invalidate(void) {
+    bcache_buf_t * buf;
+
+    if (bcache_sync() != 0)
+        return -1;
+    for (buf = bcache_lru.head; buf != NULL; buf = next_bcache_buf_list(buf)) {
+        if (buf->valid)
+            bcache_hash_remove(buf);
+        buf->valid = 0;
+        buf->readahead = 0;
+    }
+    bcache_last_buffer = 0xFFFFFFFF;
+    return 0;
+}
+
+void bcache_get_stats(bcache_stats_t * stats) {
+    *stats = bcache_stats;
+}
+
+void bcache_reset_stats(void) {
+    bzero(&bcache_stats, sizeof(bcache_stats));
+}
@@ -0,0 +1,710 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/bcache.h>
+#include <kernel/bench.h>
+#include <kernel/cpu.h>
+#include <kernel/emmc.h>
+#include <kernel/fbcon.h>
+#include <kernel/font.h>
+#include <kernel/mem.h>
+#include <kernel/mmu.h>
+#include <kernel/printk.h>
+#include <kernel/task.h>
+#include <kernel/timer.h>
+#include <kernel/uart.h>
+#include <kernel/vm.h>
+#include <common/stdio.h>
+#include <common/stdlib.h>
+#include <common/string.h>
+#include <user/programs.h>
+
+#define BENCH_UART_BYTES 4096
+// Sequential read size for the SD benchmark, 2 MB
+#define BENCH_SD_BLOCKS 4096
+// How much of the end of the sequential read gets read again, in pages.  Fits in the cache
+#define BENCH_SD_REREAD_PAGES 32
+#define BENCH_TIMER_COUNT 32768
+// Expiries are spread over this many ms, so the timers start out on every level of the wheel
+#define BENCH_TIMER_SPREAD_MS 600000
+#define BENCH_TIMER_RUN_MS 2000
+#define BENCH_TIMERS_PER_PAGE (PAGE_SIZE / sizeof(timer_t))
+// Numbers parsed and formatted by the string benchmark, and the length of the strings it scans
+#define BENCH_STRING_NUMBERS 20000
+#define BENCH_STRING_LEN 200
+// Each string's buffer, a multiple of 8 so both start word aligned and strcmp goes a word at a time
+#define BENCH_STRING_ROW ((BENCH_STRING_LEN + 1 + 7) & ~7)
+#define BENCH_STRING_PASSES 2000
+// A quarter of the log ring, so most of dmesg survives the log benchmark
+#define BENCH_LOG_MESSAGES (LOG_RING_SIZE / 4)
+// Console benchmark text, in lines that fit an 80 column terminal with the newline
+#define BENCH_CONSOLE_LINES 64
+#define BENCH_CONSOLE_LINE_LEN 80
+#define BENCH_CONSOLE_CHARS (BENCH_CONSOLE_LINES * BENCH_CONSOLE_LINE_LEN)
+// The TLB benchmark's region, 4 MB so no mapping size fits it all in the TLB as 4 KB pages
+#define BENCH_TLB_SIZE 0x400000
+#define BENCH_TLB_PAGES (BENCH_TLB_SIZE / PAGE_SIZE)
+#define BENCH_TLB_PASSES 8
+
+static const uint32_t bench_uart_rates[] = {
+    115200, 230400, 460800, 921600, 1500000, 3000000,
+};
+#define BENCH_UART_NUM_RATES (sizeof(bench_uart_rates) / sizeof(bench_uart_rates[0]))
+
+// Print s left aligned in a column of the given width
+static void bench_print_col(const char * s, int width) {
+    puts(s);
+    while (*s++)
+        width--;
+    while (width-- > 0)
+        putc(' ');
+}
+
+static uint32_t bench_per_sec(uint32_t count, uint32_t usecs) {
+    uint64_t rate;
+
+    if (usecs == 0)
+        usecs = 1;
+    rate = (uint64_t)count * SYSTEM_TIMER_HZ / usecs;
+    return rate > 0x7fffffff ? 0x7fffffff : rate;
+}
+
+// Print a byte rate as MB/s with two decimals
+static void bench_print_mbs(uint32_t bytes, uint32_t usecs) {
+    uint64_t rate;
+
+    if (usecs == 0)
+        usecs = 1;
+    rate = (uint64_t)bytes * SYSTEM_TIMER_HZ / usecs;
+    puts(itoa(rate >> 20));
+    putc('.');
+    rate = ((rate & 0xFFFFF) * 100) >> 20;
+    if (rate < 10)
+        putc('0');
+    puts(itoa(rate));
+    puts(" MB/s");
+}
+
+void bench_uart(void) {
+    static char payload[BENCH_UART_BYTES];
+    uint32_t putc_us[BENCH_UART_NUM_RATES], burst_us[BENCH_UART_NUM_RATES];
+    int supported[BENCH_UART_NUM_RATES];
+    uint32_t i, j, start, measured = 0;
+
+    // Printable 64 character lines so a terminal at the right rate shows something sane
+    for (i = 0; i < BENCH_UART_BYTES; i++) {
+        j = i % 64;
+        payload[i] = j == 62 ? '\r' : j == 63 ? '\n' : 'A' + (j % 26);
+    }
+
+    puts("Benchmarking UART transmit, ");
+    puts(itoa(BENCH_UART_BYTES));
+    puts(" bytes per run.\nOutput is garbled while the baud rate differs from the terminal's.\n");
+
+    for (i = 0; i < BENCH_UART_NUM_RATES; i++) {
+        supported[i] = uart_set_baud(bench_uart_rates[i]) == 0;
+        if (!supported[i])
+            continue;
+        measured++;
+
+        start = timer_get_ticks();
+        for (j = 0; j < BENCH_UART_BYTES; j++)
+            uart_putc(payload[j]);
+        uart_flush();
+        putc_us[i] = timer_get_ticks() - start;
+
+        start = timer_get_ticks();
+        uart_write(payload, BENCH_UART_BYTES);
+        uart_flush();
+        burst_us[i] = timer_get_ticks() - start;
+    }
+    uart_set_baud(UART_DEFAULT_BAUD);
+
+    puts("\nUART clock: ");
+    puts(itoa(uart_get_clock()));
+    puts(" Hz\n");
+    bench_print_col("baud", 10);
+    bench_print_col("line B/s", 12);
+    bench_print_col("putc B/s", 12);
+    bench_print_col("burst B/s", 12);
+    putc('\n');
+    for (i = 0; i < BENCH_UART_NUM_RATES; i++) {
+        bench_print_col(itoa(bench_uart_rates[i]), 10);
+        if (!supported[i]) {
+            puts("unsupported at this UART clock\n");
+            continue;
+        }
+        // 8N1 framing puts 10 bits on the wire per byte
+        bench_print_col(itoa(bench_uart_rates[i] / 10), 12);
+        bench_print_col(itoa(bench_per_sec(BENCH_UART_BYTES, putc_us[i])), 12);
+        bench_print_col(itoa(bench_per_sec(BENCH_UART_BYTES, burst_us[i])), 12);
+        putc('\n');
+    }
+    // qemu's firmware keeps the UART at 3 MHz, so only the slowest rate runs there
+    puts("Measured ");
+    puts(itoa(measured));
+    puts(" of ");
+    puts(itoa(BENCH_UART_NUM_RATES));
+    puts(" rates, this clock goes up to ");
+    puts(itoa(uart_get_clock() / 16));
+    puts(" baud\n");
+}
+
+static void bench_sd_line(const char * name, uint32_t bytes, uint32_t usecs) {
+    bench_print_col(name, 28);
+    bench_print_mbs(bytes, usecs);
+    putc('\n');
+}
+
+void bench_sd(void) {
+    bcache_stats_t stats;
+    uint8_t * page;
+    uint32_t i, start, usecs;
+
+    if (!bcache_ready()) {
+        puts("No SD card, skipping the SD benchmark\n");
+        return;
+    }
+    page = alloc_page();
+    if (!page) {
+        puts("Out of memory\n");
+        return;
+    }
+
+    puts("Reading ");
+    puts(itoa(BENCH_SD_BLOCKS * EMMC_BLOCK_SIZE / 1024));
+    puts(" KB from the SD card\n");
+
+    // Straight from the card, one command per block, then one multi block command per page
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_SD_BLOCKS; i++) {
+        if (emmc_read_blocks(i, 1, page) != 0)
+            goto fail;
+    }
+    bench_sd_line("raw, single block", BENCH_SD_BLOCKS * EMMC_BLOCK_SIZE, timer_get_ticks() - start);
+
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_SD_BLOCKS; i += PAGE_SIZE / EMMC_BLOCK_SIZE) {
+        if (emmc_read_blocks(i, PAGE_SIZE / EMMC_BLOCK_SIZE, page) != 0)
+            goto fail;
+    }
+    bench_sd_line("raw, multi block", BENCH_SD_BLOCKS * EMMC_BLOCK_SIZE, timer_get_ticks() - start);
+
+    // Through a cold cache, sequential, so read ahead kicks in
+    if (bcache_invalidate() != 0)
+        goto fail;
+    bcache_reset_stats();
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_SD_BLOCKS; i += PAGE_SIZE / EMMC_BLOCK_SIZE) {
+        if (bcache_read(i, PAGE_SIZE / EMMC_BLOCK_SIZE, page) != 0)
+            goto fail;
+    }
+    bench_sd_line("cache, cold sequential", BENCH_SD_BLOCKS * EMMC_BLOCK_SIZE, timer_get_ticks() - start);
+
+    // Then the tail of it again, which is still cached
+    start = timer_get_ticks();
+    for (i = BENCH_SD_BLOCKS - BENCH_SD_REREAD_PAGES * (PAGE_SIZE / EMMC_BLOCK_SIZE); i < BENCH_SD_BLOCKS;
+            i += PAGE_SIZE / EMMC_BLOCK_SIZE) {
+        if (bcache_read(i, PAGE_SIZE / EMMC_BLOCK_SIZE, page) != 0)
+            goto fail;
+    }
+    usecs = timer_get_ticks() - start;
+    bench_sd_line("cache, hot re-read", BENCH_SD_REREAD_PAGES * PAGE_SIZE, usecs);
+
+    bcache_get_stats(&stats);
+    puts("cache hits: ");
+    puts(itoa(stats.hits));
+    puts(", misses: ");
+    puts(itoa(stats.misses));
+    puts(", hit rate: ");
+    puts(itoa(stats.hits + stats.misses ? stats.hits * 100 / (stats.hits + stats.misses) : 0));
+    puts("%\nread ahead: ");
+    puts(itoa(stats.readaheads));
+    puts(" buffers, ");
+    puts(itoa(stats.readahead_hits));
+    puts(" used\n");
+    free_page(page);
+    return;
+
+fail:
+    puts("SD read failed\n");
+    free_page(page);
+}
+
+static volatile uint32_t bench_timer_fired;
+
+static void bench_timer_callback(void * data) {
+    (void) data;
+    bench_timer_fired++;
+}
+
+// Let the tick run for a while and report what it cost
+static void bench_timer_run(const char * name) {
+    timer_stats_t stats;
+
+    timer_reset_stats();
+    udelay(BENCH_TIMER_RUN_MS * 1000);
+    timer_get_stats(&stats);
+
+    bench_print_col(name, 24);
+    bench_print_col(itoa(stats.pending), 10);
+    bench_print_col(itoa(stats.ticks), 8);
+    bench_print_col(itoa(stats.ticks ? (uint32_t)(stats.total_irq_cycles / stats.ticks) : 0), 12);
+    bench_print_col(itoa(stats.max_irq_cycles), 12);
+    bench_print_col(itoa(stats.expired), 10);
+    puts(itoa(stats.cascaded));
+    putc('\n');
+}
+
+void bench_timers(void) {
+    uint32_t npages = (BENCH_TIMER_COUNT + BENCH_TIMERS_PER_PAGE - 1) / BENCH_TIMERS_PER_PAGE;
+    uint32_t i, seed = 1, start, add_cycles, cancel_cycles;
+    timer_t ** pages;
+    timer_t * timer;
+
+    pages = kmalloc(npages * sizeof(timer_t *));
+    if (!pages) {
+        puts("Out of memory\n");
+        return;
+    }
+    for (i = 0; i < npages; i++) {
+        if ((pages[i] = alloc_page()) == NULL) {
+            puts("Out of memory\n");
+            while (i--)
+                free_page(pages[i]);
+            kfree(pages);
+            return;
+        }
+    }
+#define BENCH_TIMER(i) (&pages[(i) / BENCH_TIMERS_PER_PAGE][(i) % BENCH_TIMERS_PER_PAGE])
+
+    puts("Timer wheel with ");
+    puts(itoa(BENCH_TIMER_COUNT));
+    puts(" timers, tick every ");
+    puts(itoa(TIMER_TICK_US));
+    puts(" us\n");
+    bench_print_col("", 24);
+    bench_print_col("pending", 10);
+    bench_print_col("ticks", 8);
+    bench_print_col("cycles/tick", 12);
+    bench_print_col("max cycles", 12);
+    bench_print_col("expired", 10);
+    puts("cascaded\n");
+    bench_timer_run("idle");
+
+    bench_timer_fired = 0;
+    start = cpu_cycles();
+    for (i = 0; i < BENCH_TIMER_COUNT; i++) {
+        // Numerical Recipes LCG, good enough to scatter the expiries
+        seed = seed * 1664525 + 1013904223;
+        timer = BENCH_TIMER(i);
+        timer_setup(timer, bench_timer_callback, NULL);
+        timer_add(timer, 1 + (seed >> 8) % BENCH_TIMER_SPREAD_MS);
+    }
+    add_cycles = cpu_cycles() - start;
+    bench_timer_run("loaded");
+
+    start = cpu_cycles();
+    for (i = 0; i < BENCH_TIMER_COUNT; i++)
+        timer_cancel(BENCH_TIMER(i));
+    cancel_cycles = cpu_cycles() - start;
+#undef BENCH_TIMER
+
+    puts("timer_add: ");
+    puts(itoa(add_cycles / BENCH_TIMER_COUNT));
+    puts(" cycles, timer_cancel: ");
+    puts(itoa(cancel_cycles / BENCH_TIMER_COUNT));
+    puts(" cycles, callbacks run: ");
+    puts(itoa(bench_timer_fired));
+    putc('\n');
+
+    for (i = 0; i < npages; i++)
+        free_page(pages[i]);
+    kfree(pages);
+}
+
+void bench_syscalls(void) {
+    static const char * names[SYSBENCH_OPS] = {
+        "empty loop", "getpid (fast path)", "time (fast path)", "write (slow path)",
+        "yield (slow path, 2 switches)", "vdso read",
+    };
+    uint32_t cycles[SYSBENCH_OPS], op, start;
+
+    // Each operation gets a task of its own, timed from creation to exit with the cycles of the
+    // empty loop taken off, which leaves the round trip into the kernel and back
+    for (op = 0; op < SYSBENCH_OPS; op++) {
+        if (task_create("sysbench", sysbench_main, op) < 0) {
+            puts("Out of memory\n");
+            return;
+        }
+        start = cpu_cycles();
+        task_schedule();
+        cycles[op] = cpu_cycles() - start;
+    }
+
+    puts("System call round trips, cycles per call over ");
+    puts(itoa(SYSBENCH_ITERATIONS));
+    puts(" calls\n");
+    for (op = 1; op < SYSBENCH_OPS; op++) {
+        bench_print_col(names[op], 32);
+        puts(itoa(cycles[op] > cycles[0] ? (cycles[op] - cycles[0]) / SYSBENCH_ITERATIONS : 0));
+        putc('\n');
+    }
+}
+
+// What the shell used before string.c, to compare against: a byte at a time, a division per digit.
+// noipa keeps the compiler from noticing they are pure and calling them once per loop
+static __attribute__((noipa)) size_t bench_strlen_bytes(const char * s) {
+    size_t len = 0;
+
+    while (s[len] != '\0')
+        len++;
+    return len;
+}
+
+static __attribute__((noipa)) int bench_strcmp_bytes(const char * s1, const char * s2) {
+    while (*s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return (unsigned char)*s1 - (unsigned char)*s2;
+}
+
+static __attribute__((noipa)) int bench_atoi(const char * s) {
+    uint32_t result = 0, negative = 0;
+
+    if (*s == '-') {
+        negative = 1;
+        s++;
+    }
+    while (*s >= '0' && *s <= '9')
+        result = result * 10 + (*s++ - '0');
+    return negative ? 0 - result : result;
+}
+
+static __attribute__((noipa)) int bench_utoa_div(uint32_t value, char * buf) {
+    char tmp[UTOA_BUF_SIZE];
+    int len = 0, i;
+
+    do {
+        tmp[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    for (i = 0; i < len; i++)
+        buf[i] = tmp[len - 1 - i];
+    buf[len] = '\0';
+    return len;
+}
+
+static void bench_string_line(const char * name, uint32_t count, uint32_t old_usecs, uint32_t new_usecs) {
+    bench_print_col(name, 12);
+    bench_print_col(itoa(bench_per_sec(count, old_usecs)), 14);
+    bench_print_col(itoa(bench_per_sec(count, new_usecs)), 14);
+    putc('\n');
+}
+
+void bench_strings(void) {
+    // Numbers go ITOA_BUF_SIZE bytes apart, one per slot
+    uint32_t npages = (BENCH_STRING_NUMBERS * ITOA_BUF_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t i, seed = 1, start, old_usecs, new_usecs;
+    char * numbers = alloc_pages(npages), * slot;
+    char text[2][BENCH_STRING_ROW] __attribute__((aligned(8)));
+    volatile uint32_t sink = 0;
+    int32_t value;
+
+    if (numbers == NULL) {
+        puts("Out of memory\n");
+        return;
+    }
+    for (i = 0; i < BENCH_STRING_LEN; i++)
+        text[0][i] = text[1][i] = 'a' + i % 26;
+    text[0][BENCH_STRING_LEN] = text[1][BENCH_STRING_LEN] = '\0';
+
+    puts("String functions, calls/sec\n");
+    bench_print_col("", 12);
+    bench_print_col("bytewise", 14);
+    puts("string.c\n");
+
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_STRING_PASSES; i++)
+        sink += bench_strlen_bytes(text[0]);
+    old_usecs = timer_get_ticks() - start;
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_STRING_PASSES; i++)
+        sink += strlen(text[0]);
+    new_usecs = timer_get_ticks() - start;
+    bench_string_line("strlen", BENCH_STRING_PASSES, old_usecs, new_usecs);
+
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_STRING_PASSES; i++)
+        sink += bench_strcmp_bytes(text[0], text[1]);
+    old_usecs = timer_get_ticks() - start;
+    start = timer_get_ticks();
+    for (i = 0; i < BENCH_STRING_PASSES; i++)
+        sink += strcmp(text[0], text[1]);
+    new_usecs = timer_get_ticks() - start;
+    bench_string_line("strcmp", BENCH_STRING_PASSES, old_usecs, new_usecs);
+
+    // Formatting fills the slots with numbers of every length, which the parsers then read back
+    start = timer_get_ticks();
+    for (i = 0, slot = numbers; i < BENCH_STRING_NUMBERS; i++, slot += ITOA_BUF_SIZE) {
+        seed = seed * 1664525 + 1013904223;
+        sink += bench_utoa_div(seed >> (seed & 31), slot);
+    }
+    old_usecs = timer_get_ticks() - start;
+    seed = 1;
+    start = timer_get_ticks();
+    for (i = 0, slot = numbers; i < BENCH_STRING_NUMBERS; i++, slot += ITOA_BUF_SIZE) {
+        seed = seed * 1664525 + 1013904223;
+        sink += utoa_r(seed >> (seed & 31), slot);
+    }
+    new_usecs = timer_get_ticks() - start;
+    bench_string_line("format", BENCH_STRING_NUMBERS, old_usecs, new_usecs);
+
+    // The values are up to 32 bits, so strtol32 turns some away as too big where atoi wraps.
+    // It does the same work either way
+    start = timer_get_ticks();
+    for (i = 0, slot = numbers; i < BENCH_STRING_NUMBERS; i++, slot += ITOA_BUF_SIZE)
+        sink += bench_atoi(slot);
+    old_usecs = timer_get_ticks() - start;
+    start = timer_get_ticks();
+    for (i = 0, slot = numbers; i < BENCH_STRING_NUMBERS; i++, slot += ITOA_BUF_SIZE)
+        if (strtol32(slot, NULL, 10, &value) == 0)
+            sink += value;
+    new_usecs = timer_get_ticks() - start;
+    bench_string_line("parse", BENCH_STRING_NUMBERS, old_usecs, new_usecs);
+
+    for (i = 0; i < npages; i++)
+        free_page(numbers + i * PAGE_SIZE);
+}
+
+void bench_log(void) {
+    static const char line[] = "kmalloc: no free segment for 4096 bytes\n";
+    uint32_t i, start, printk_cycles, puts_cycles;
+
+    // Debug records stay out of the console, so this is only the cost to the caller.  They do push
+    // as many of the oldest records out of a full ring
+    start = cpu_cycles();
+    for (i = 0; i < BENCH_LOG_MESSAGES; i++)
+        printk(LOG_DEBUG, "kmalloc: no free segment for %u bytes", 4096);
+    printk_cycles = (cpu_cycles() - start) / BENCH_LOG_MESSAGES;
+
+    uart_flush();
+    start = cpu_cycles();
+    uart_puts(line);
+    puts_cycles = cpu_cycles() - start;
+
+    puts("printk: ");
+    puts(itoa(printk_cycles));
+    puts(" cycles, puts of the same line at ");
+    puts(itoa(uart_get_baud()));
+    puts(" baud: ");
+    puts(itoa(puts_cycles));
+    puts(" cycles\n");
+    puts(itoa(BENCH_LOG_MESSAGES));
+    puts(" debug records added to dmesg\n");
+}
+
+// Write the benchmark text a line at a time, the way the shell prints
+static uint32_t bench_console_run(const char * text, int fb) {
+    uint32_t i, start = timer_get_ticks();
+
+    for (i = 0; i < BENCH_CONSOLE_LINES; i++) {
+        if (fb)
+            fbcon_write(text + i * BENCH_CONSOLE_LINE_LEN, BENCH_CONSOLE_LINE_LEN);
+        else
+            uart_write(text + i * BENCH_CONSOLE_LINE_LEN, BENCH_CONSOLE_LINE_LEN);
+    }
+    if (!fb)
+        uart_flush();
+    return timer_get_ticks() - start;
+}
+
+void bench_console(void) {
+    static char text[BENCH_CONSOLE_CHARS];
+    static const char * scroll_names[] = { "fb, offset scroll", "fb, memmove scroll" };
+    uint32_t fb_us[2], fb_moves[2], uart_us, i;
+    int supported[2];
+    fbcon_scroll_t mode = fbcon_get_scroll();
+    fbcon_stats_t before, after;
+
+    for (i = 0; i < BENCH_CONSOLE_CHARS; i++)
+        text[i] = (i + 1) % BENCH_CONSOLE_LINE_LEN ? FONT_FIRST + i % FONT_GLYPHS : '\n';
+
+    uart_flush();
+    uart_us = bench_console_run(text, 0);
+    for (i = 0; i < 2; i++) {
+        supported[i] = fbcon_set_scroll(i == 0 ? FBCON_SCROLL_OFFSET : FBCON_SCROLL_MEMMOVE) == 0;
+        if (!supported[i])
+            continue;
+        fbcon_get_stats(&before);
+        fb_us[i] = bench_console_run(text, 1);
+        fbcon_get_stats(&after);
+        fb_moves[i] = after.moves - before.moves;
+    }
+    fbcon_set_scroll(mode);
+
+    puts("\nConsole output, ");
+    puts(itoa(BENCH_CONSOLE_LINES));
+    puts(" lines of ");
+    puts(itoa(BENCH_CONSOLE_LINE_LEN));
+    puts(" characters, uart at ");
+    puts(itoa(uart_get_baud()));
+    puts(" baud:\n");
+    bench_print_col("", 20);
+    bench_print_col("chars/s", 12);
+    puts("screen moves\n");
+    bench_print_col("uart", 20);
+    bench_print_col(itoa(bench_per_sec(BENCH_CONSOLE_CHARS, uart_us)), 12);
+    puts("-\n");
+    for (i = 0; i < 2; i++) {
+        bench_print_col(scroll_names[i], 20);
+        if (!fbcon_ready()) {
+            puts("no framebuffer\n");
+            continue;
+        } else if (!supported[i]) {
+            puts("no virtual offset\n");
+            continue;
+        }
+        bench_print_col(itoa(bench_per_sec(BENCH_CONSOLE_CHARS, fb_us[i])), 12);
+        puts(itoa(fb_moves[i]));
+        putc('\n');
+    }
+}
+
+// Cycles per access for one load from each page in order, over every pass.  The offset in the
+// page moves a cache line along each time so it isn't the same line of every page
+static uint32_t bench_tlb_run(const volatile uint8_t * va, const uint16_t * order) {
+    uint32_t i, pass, start, sink = 0;
+
+    start = cpu_cycles();
+    for (pass = 0; pass < BENCH_TLB_PASSES; pass++)
+        for (i = 0; i < BENCH_TLB_PAGES; i++)
+            sink += va[order[i] * PAGE_SIZE + (order[i] % 64) * 64];
+    (void) sink;
+    return (cpu_cycles() - start) / (BENCH_TLB_PASSES * BENCH_TLB_PAGES);
+}
+
+void bench_tlb(void) {
+    static const uint32_t map_flags[] = { VM_SMALL_PAGES, VM_NO_SECTIONS, 0 };
+    static const char * map_names[] = { "4 KB pages", "64 KB large pages", "1 MB sections" };
+    uint32_t stride_cycles[3], random_cycles[3], mappings[3], faults[2], touch_cycles[2];
+    uint32_t i, j, start, seed = 1;
+    uint16_t * stride, * random, swap;
+    uint8_t * phys, * va;
+    vm_stats_t before, after;
+
+    if (!vm_enabled()) {
+        puts("No MMU, addresses are physical\n");
+        return;
+    }
+    stride = kmalloc(2 * BENCH_TLB_PAGES * sizeof(uint16_t));
+    // Section aligned, so kmap can use any size of mapping over it
+    phys = alloc_pages_aligned(BENCH_TLB_PAGES, SECTION_SIZE / PAGE_SIZE);
+    if (stride == NULL || phys == NULL) {
+        puts("Out of memory\n");
+        if (stride != NULL)
+            kfree(stride);
+        if (phys != NULL)
+            for (i = 0; i < BENCH_TLB_PAGES; i++)
+                free_page(phys + i * PAGE_SIZE);
+        return;
+    }
+    random = stride + BENCH_TLB_PAGES;
+    for (i = 0; i < BENCH_TLB_PAGES; i++)
+        stride[i] = random[i] = i;
+    for (i = BENCH_TLB_PAGES - 1; i > 0; i--) {
+        seed = seed * 1664525 + 1013904223;
+        j = (seed >> 8) % (i + 1);
+        swap = random[i];
+        random[i] = random[j];
+        random[j] = swap;
+    }
+
+    // The same physical memory mapped with each size in turn
+    for (i = 0; i < 3; i++) {
+        vm_get_stats(&before);
+        if ((va = kmap((uintptr_t)phys, BENCH_TLB_SIZE, map_flags[i])) == NULL) {
+            mappings[i] = 0;
+            continue;
+        }
+        vm_get_stats(&after);
+        mappings[i] = after.sections + after.large_pages + after.small_pages -
+                      before.sections - before.large_pages - before.small_pages;
+        if (virt_to_phys(va + BENCH_TLB_SIZE - 1) != (uintptr_t)phys + BENCH_TLB_SIZE - 1)
+            puts("kmap: wrong physical address\n");
+        bench_tlb_run(va, stride);
+        stride_cycles[i] = bench_tlb_run(va, stride);
+        random_cycles[i] = bench_tlb_run(va, random);
+        kunmap(va);
+    }
+    for (i = 0; i < BENCH_TLB_PAGES; i++)
+        free_page(phys + i * PAGE_SIZE);
+
+    // First touch of each page of a vmalloc area, backed a page at a time or as big as it can be
+    for (i = 0; i < 2; i++) {
+        vm_get_stats(&before);
+        start = cpu_cycles();
+        if ((va = vmalloc(BENCH_TLB_SIZE, i == 0 ? VM_SMALL_PAGES : 0)) == NULL) {
+            faults[i] = 0;
+            continue;
+        }
+        for (j = 0; j < BENCH_TLB_PAGES; j++)
+            va[j * PAGE_SIZE] = j;
+        touch_cycles[i] = (cpu_cycles() - start) / BENCH_TLB_PAGES;
+        vm_get_stats(&after);
+        faults[i] = after.faults - before.faults;
+        vfree(va);
+    }
+    kfree(stride);
+
+    puts("\nLoads from ");
+    puts(itoa(BENCH_TLB_SIZE / 1024));
+    puts(" KB, one per page, kmapped with:\n");
+    bench_print_col("", 20);
+    bench_print_col("mappings", 10);
+    bench_print_col("in order", 10);
+    puts("random (cycles/load)\n");
+    for (i = 0; i < 3; i++) {
+        bench_print_col(map_names[i], 20);
+        if (mappings[i] == 0) {
+            puts("no room\n");
+            continue;
+        }
+        bench_print_col(itoa(mappings[i]), 10);
+        bench_print_col(itoa(stride_cycles[i]), 10);
+        puts(itoa(random_cycles[i]));
+        putc('\n');
+    }
+    puts("First touch of a ");
+    puts(itoa(BENCH_TLB_SIZE / 1024));
+    puts(" KB vmalloc:\n");
+    bench_print_col("", 20);
+    bench_print_col("faults", 10);
+    puts("cycles/page\n");
+    for (i = 0; i < 2; i++) {
+        bench_print_col(i == 0 ? "4 KB pages" : "biggest fit", 20);
+        if (faults[i] == 0) {
+            puts("no room\n");
+            continue;
+        }
+        bench_print_col(itoa(faults[i]), 10);
+        puts(itoa(touch_cycles[i]));
+        putc('\n');
+    }
+}
+
+void bench_all(void) {
+#ifdef __aarch64__
+    puts("Benchmarks for aarch64\n");
+#else
+    puts("Benchmarks for arm\n");
+#endif
+    bench_uart();
+    bench_sd();
+    bench_timers();
+    bench_syscalls();
+    bench_strings();
+    bench_log();
+    bench_console();
+    bench_tlb();
+}
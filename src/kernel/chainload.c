@@ -0,0 +1,346 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/chainload.h>
+#include <kernel/cpu.h>
+#include <kernel/mem.h>
+#include <kernel/mmu.h>
+#include <kernel/timer.h>
+#include <kernel/uart.h>
+#include <common/crc32.h>
+#include <common/stdio.h>
+#include <common/stdlib.h>
+
+#define CHAINLOAD_HEADER_SIZE 28
+#define CHAINLOAD_FRAME_START 0x01
+#define CHAINLOAD_ACK 0x06
+#define CHAINLOAD_NAK 0x15
+
+// "RCL1" goes out this often while waiting for the host, for this many tries
+#define CHAINLOAD_HELLO_US 1000000
+#define CHAINLOAD_HELLO_TRIES 30
+// Give the host this long to show up at a new baud rate
+#define CHAINLOAD_SYNC_US 3000000
+// A frame that doesn't arrive in time is NAKed, and the transfer given up after this many in a row
+#define CHAINLOAD_FRAME_US 500000
+#define CHAINLOAD_MAX_RETRIES 10
+// The line is quiet once nothing arrives for this long
+#define CHAINLOAD_DRAIN_US 20000
+
+// The trampoline is copied to the start of a page, with the table of staging pages after it
+#define CHAINLOAD_TABLE_OFFSET 256
+#define CHAINLOAD_MAX_PAGES ((PAGE_SIZE - CHAINLOAD_TABLE_OFFSET) / sizeof(void *))
+
+typedef void (*chainload_trampoline_t)(void * dest, void ** pages, uint32_t npages, void * entry);
+
+extern uint8_t __start;
+extern char chainload_trampoline[];
+extern char chainload_trampoline_end[];
+
+typedef struct {
+    uint32_t size;
+    uint32_t load_addr;
+    uint32_t entry;
+    uint32_t baud;
+    uint32_t image_crc;
+} chainload_header_t;
+
+static uint32_t get_le32(const uint8_t * p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t * p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+// Read len bytes, giving up if any one of them takes longer than usecs
+static int chainload_read(uint8_t * buf, uint32_t len, uint32_t usecs) {
+    int c;
+
+    while (len--) {
+        if ((c = uart_getc_timeout(usecs)) < 0)
+            return -1;
+        *buf++ = c;
+    }
+    return 0;
+}
+
+// Wait for a 4 byte magic, skipping anything in front of it
+static int chainload_expect(const char * magic, uint32_t usecs) {
+    uint32_t want = get_le32((const uint8_t *)magic), window = 0;
+    int c;
+
+    while ((c = uart_getc_timeout(usecs)) >= 0) {
+        window = (window >> 8) | ((uint32_t)c << 24);
+        if (window == want)
+            return 0;
+    }
+    return -1;
+}
+
+static void chainload_drain(void) {
+    while (uart_getc_timeout(CHAINLOAD_DRAIN_US) >= 0);
+}
+
+static void chainload_reply(const char * magic, chainload_status_t status) {
+    uint8_t reply[8];
+
+    memcpy(reply, (void *)magic, 4);
+    put_le32(reply + 4, status);
+    uart_write((const char *)reply, sizeof(reply));
+}
+
+static void chainload_answer(uint8_t type, uint16_t seq) {
+    char answer[3] = { type, seq, seq >> 8 };
+
+    uart_write(answer, sizeof(answer));
+}
+
+// Where byte offset of the image goes.  Blobs land in place, kernels in staging pages
+// allocated as the data arrives
+static uint8_t * chainload_dest(const chainload_header_t * header, void ** pages, uint32_t offset) {
+    uint32_t page = offset / PAGE_SIZE;
+
+    if (header->entry == CHAINLOAD_NO_ENTRY)
+        return (uint8_t *)(uintptr_t)header->load_addr + offset;
+    if (pages[page] == NULL && (pages[page] = alloc_page()) == NULL)
+        return NULL;
+    return (uint8_t *)pages[page] + offset % PAGE_SIZE;
+}
+
+static chainload_status_t chainload_check(const uint8_t * raw, chainload_header_t * header) {
+    uint32_t npages;
+
+    if (crc32(raw, CHAINLOAD_HEADER_SIZE - 4) != get_le32(raw + 24))
+        return CHAINLOAD_BAD_HEADER;
+    header->size = get_le32(raw + 4);
+    header->load_addr = get_le32(raw + 8);
+    header->entry = get_le32(raw + 12);
+    header->baud = get_le32(raw + 16);
+    header->image_crc = get_le32(raw + 20);
+
+    npages = (header->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (header->size == 0 || header->size > 0xFFFF * CHAINLOAD_FRAME_SIZE)
+        return CHAINLOAD_TOO_BIG;
+    if (header->entry != CHAINLOAD_NO_ENTRY && npages > CHAINLOAD_MAX_PAGES)
+        return CHAINLOAD_TOO_BIG;
+    if (header->load_addr % PAGE_SIZE || header->load_addr + header->size < header->load_addr)
+        return CHAINLOAD_BAD_ADDRESS;
+    // A new kernel replaces this one, but mustn't go below it where the ATAGs and stack live
+    if (header->entry != CHAINLOAD_NO_ENTRY &&
+            (header->load_addr < (uintptr_t)&__start || header->entry < header->load_addr ||
+             header->entry >= header->load_addr + header->size))
+        return CHAINLOAD_BAD_ADDRESS;
+    // Find out now, while the sender still listens at the old rate for the answer
+    if (header->baud != 0 && !uart_baud_supported(header->baud))
+        return CHAINLOAD_BAD_BAUD;
+    return CHAINLOAD_OK;
+}
+
+// Go-back-N receive.  ACKs are cumulative: ACK n means every frame up to n is in
+static chainload_status_t chainload_receive(const chainload_header_t * header, void ** pages) {
+    uint32_t nframes = (header->size + CHAINLOAD_FRAME_SIZE - 1) / CHAINLOAD_FRAME_SIZE;
+    uint32_t frame = 0, image_crc = CRC32_INIT, crc, len, want, retries = 0, i;
+    uint8_t head[4], tail[4];
+    uint16_t seq, ahead;
+    uint8_t * dest;
+    int c, naked = 0;
+
+    while (frame < nframes) {
+        if ((c = uart_getc_timeout(CHAINLOAD_FRAME_US)) < 0) {
+            if (++retries > CHAINLOAD_MAX_RETRIES)
+                return CHAINLOAD_TIMEOUT;
+            chainload_answer(CHAINLOAD_NAK, frame);
+            continue;
+        }
+        // Anything else is noise between frames
+        if (c != CHAINLOAD_FRAME_START)
+            continue;
+        if (chainload_read(head, sizeof(head), CHAINLOAD_FRAME_US) != 0)
+            goto bad_frame;
+        seq = head[0] | (head[1] << 8);
+        len = head[2] | (head[3] << 8);
+        if (len > CHAINLOAD_FRAME_SIZE)
+            goto bad_frame;
+
+        ahead = seq - (uint16_t)frame;
+        if (ahead != 0) {
+            // A frame sent before the host saw our NAK, or a repeat of one we already have
+            for (i = 0; i < len + sizeof(tail); i++) {
+                if (uart_getc_timeout(CHAINLOAD_FRAME_US) < 0)
+                    goto bad_frame;
+            }
+            if (ahead >= 0x8000)
+                chainload_answer(CHAINLOAD_ACK, frame - 1);
+            else if (!naked) {
+                chainload_answer(CHAINLOAD_NAK, frame);
+                naked = 1;
+            }
+            continue;
+        }
+
+        want = header->size - frame * CHAINLOAD_FRAME_SIZE;
+        if (want > CHAINLOAD_FRAME_SIZE)
+            want = CHAINLOAD_FRAME_SIZE;
+        if (len != want)
+            goto bad_frame;
+        // Frames never straddle a page, so the payload goes straight to its final place
+        if ((dest = chainload_dest(header, pages, frame * CHAINLOAD_FRAME_SIZE)) == NULL)
+            return CHAINLOAD_NO_MEMORY;
+        if (chainload_read(dest, len, CHAINLOAD_FRAME_US) != 0 ||
+                chainload_read(tail, sizeof(tail), CHAINLOAD_FRAME_US) != 0)
+            goto bad_frame;
+        crc = crc32_update(crc32_update(CRC32_INIT, head, sizeof(head)), dest, len);
+        if (crc32_final(crc) != get_le32(tail))
+            goto bad_frame;
+
+        image_crc = crc32_update(image_crc, dest, len);
+        chainload_answer(CHAINLOAD_ACK, frame);
+        frame++;
+        retries = 0;
+        naked = 0;
+        continue;
+
+bad_frame:
+        if (++retries > CHAINLOAD_MAX_RETRIES)
+            return CHAINLOAD_TIMEOUT;
+        chainload_drain();
+        chainload_answer(CHAINLOAD_NAK, frame);
+        naked = 1;
+    }
+
+    return crc32_final(image_crc) == header->image_crc ? CHAINLOAD_OK : CHAINLOAD_BAD_CRC;
+}
+
+// Switch to the new baud rate and wait for the host to follow
+static chainload_status_t chainload_sync(uint32_t baud, uint32_t old_baud) {
+    if (uart_set_baud(baud) == 0 && chainload_expect("RCLS", CHAINLOAD_SYNC_US) == 0) {
+        uart_write("RCLS", 4);
+        return CHAINLOAD_OK;
+    }
+    uart_set_baud(old_baud);
+    return CHAINLOAD_BAD_BAUD;
+}
+
+// Copy the trampoline to a page the new kernel won't overwrite, along with the table of staging pages
+static chainload_status_t chainload_prepare(const chainload_header_t * header, void ** pages, uint32_t npages,
+                                            uint8_t ** trampoline) {
+    uint32_t size = chainload_trampoline_end - chainload_trampoline, i;
+    uintptr_t end = header->load_addr + npages * PAGE_SIZE;
+    void ** table;
+
+    if ((*trampoline = alloc_page()) == NULL)
+        return CHAINLOAD_NO_MEMORY;
+    // Pages are copied in order, so none may sit where an earlier one is going
+    for (i = 0; i < npages; i++) {
+        if ((uintptr_t)pages[i] < end)
+            break;
+    }
+    if (i < npages || (uintptr_t)*trampoline < end) {
+        free_page(*trampoline);
+        return CHAINLOAD_BAD_ADDRESS;
+    }
+
+    memcpy(*trampoline, chainload_trampoline, size);
+    table = (void **)(*trampoline + CHAINLOAD_TABLE_OFFSET);
+    for (i = 0; i < npages; i++)
+        table[i] = pages[i];
+    return CHAINLOAD_OK;
+}
+
+static void chainload_start(const chainload_header_t * header, uint8_t * trampoline, uint32_t npages) {
+    puts("chainload: starting new kernel\n");
+    uart_flush();
+    irq_save();
+    // The staged pages and the trampoline must be in memory before the cache goes off with the MMU
+    dcache_clean_all();
+    // The trampoline was written through the data side, make sure no stale instructions are cached for it
+#ifdef __aarch64__
+    asm volatile("dsb sy\n ic iallu\n dsb sy\n isb" ::: "memory");
+#else
+    asm volatile("mcr p15, 0, %0, c7, c5, 0" :: "r"(0) : "memory");
+#endif
+    ((chainload_trampoline_t)trampoline)((void *)(uintptr_t)header->load_addr,
+                                         (void **)(trampoline + CHAINLOAD_TABLE_OFFSET), npages,
+                                         (void *)(uintptr_t)header->entry);
+}
+
+chainload_status_t chainload(void) {
+    uint8_t raw[CHAINLOAD_HEADER_SIZE], * trampoline = NULL;
+    chainload_header_t header;
+    chainload_status_t status;
+    uint32_t old_baud = uart_get_baud(), npages = 0, start, elapsed, i;
+    void ** pages = NULL;
+    int tries;
+
+    puts("chainload: waiting for sender\n");
+    for (tries = 0; tries < CHAINLOAD_HELLO_TRIES; tries++) {
+        uart_write("RCL1", 4);
+        if (chainload_expect("RCLH", CHAINLOAD_HELLO_US) == 0)
+            break;
+    }
+    if (tries == CHAINLOAD_HELLO_TRIES)
+        return CHAINLOAD_TIMEOUT;
+
+    memcpy(raw, "RCLH", 4);
+    if (chainload_read(raw + 4, CHAINLOAD_HEADER_SIZE - 4, CHAINLOAD_FRAME_US) != 0)
+        status = CHAINLOAD_TIMEOUT;
+    else
+        status = chainload_check(raw, &header);
+
+    if (status == CHAINLOAD_OK) {
+        npages = (header.size + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (header.entry == CHAINLOAD_NO_ENTRY) {
+            if (alloc_pages_at((void *)(uintptr_t)header.load_addr, npages) == NULL)
+                status = CHAINLOAD_BAD_ADDRESS;
+        } else {
+            if ((pages = kmalloc(npages * sizeof(void *))) == NULL)
+                status = CHAINLOAD_NO_MEMORY;
+            else
+                bzero(pages, npages * sizeof(void *));
+        }
+    }
+    chainload_reply("RCLA", status);
+    if (status != CHAINLOAD_OK)
+        return status;
+
+    if (header.baud != 0 && header.baud != old_baud)
+        status = chainload_sync(header.baud, old_baud);
+
+    start = timer_get_ticks();
+    if (status == CHAINLOAD_OK)
+        status = chainload_receive(&header, pages);
+    elapsed = timer_get_ticks() - start;
+    if (status == CHAINLOAD_OK && pages != NULL)
+        status = chainload_prepare(&header, pages, npages, &trampoline);
+    chainload_reply("RCLD", status);
+    uart_set_baud(old_baud);
+
+    if (status == CHAINLOAD_OK && trampoline != NULL)
+        chainload_start(&header, trampoline, npages);
+
+    // Only get here with a blob, or if something went wrong
+    if (pages != NULL) {
+        for (i = 0; i < npages; i++) {
+            if (pages[i] != NULL)
+                free_page(pages[i]);
+        }
+        kfree(pages);
+    } else if (status != CHAINLOAD_OK) {
+        for (i = 0; i < npages; i++)
+            free_page((uint8_t *)(uintptr_t)header.load_addr + i * PAGE_SIZE);
+    }
+
+    if (status == CHAINLOAD_OK) {
+        puts("chainload: ");
+        puts(itoa(header.size));
+        puts(" bytes in ");
+        puts(itoa(elapsed / 1000));
+        puts(" ms, ");
+        puts(itoa(elapsed ? (int)((uint64_t)header.size * 1000000 / elapsed) : 0));
+        puts(" bytes/s\n");
+    }
+    return status;
+}
@@ -0,0 +1,317 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/emmc.h>
+#include <kernel/mailbox.h>
+#include <kernel/timer.h>
+#include <kernel/uart.h>
+
+// EMMC_STATUS bits
+#define STATUS_CMD_INHIBIT (1 << 0)
+#define STATUS_DAT_INHIBIT (1 << 1)
+
+// EMMC_INTERRUPT bits
+#define INT_CMD_DONE   (1 << 0)
+#define INT_DATA_DONE  (1 << 1)
+#define INT_WRITE_RDY  (1 << 4)
+#define INT_READ_RDY   (1 << 5)
+#define INT_ERROR_MASK 0x017F8000
+
+// EMMC_CONTROL0 bits
+#define C0_HCTL_DWIDTH (1 << 1)     // 4 bit data bus
+
+// EMMC_CONTROL1 bits
+#define C1_CLK_INTLEN    (1 << 0)
+#define C1_CLK_STABLE    (1 << 1)
+#define C1_CLK_EN        (1 << 2)
+#define C1_CLK_FREQ_MASK 0xFFE0
+#define C1_TOUNIT_MAX    (0xE << 16)
+#define C1_SRST_HC       (1 << 24)
+#define C1_SRST_CMD      (1 << 25)
+#define C1_SRST_DATA     (1 << 26)
+
+// EMMC_CMDTM fields
+#define CMD_INDEX(i)     ((i) << 24)
+#define CMD_RSPNS_136    (1 << 16)
+#define CMD_RSPNS_48     (2 << 16)
+#define CMD_RSPNS_48B    (3 << 16)
+#define CMD_CRCCHK       (1 << 19)
+#define CMD_IXCHK        (1 << 20)
+#define CMD_ISDATA       (1 << 21)
+#define TM_BLKCNT_EN     (1 << 1)
+#define TM_AUTO_CMD12    (1 << 2)
+#define TM_DAT_DIR_READ  (1 << 4)
+#define TM_MULTI_BLOCK   (1 << 5)
+
+#define CMD_R1 (CMD_RSPNS_48 | CMD_CRCCHK | CMD_IXCHK)
+
+// The commands we use, pre-encoded for EMMC_CMDTM
+#define CMD_GO_IDLE        CMD_INDEX(0)
+#define CMD_ALL_SEND_CID   (CMD_INDEX(2) | CMD_RSPNS_136 | CMD_CRCCHK)
+#define CMD_SEND_REL_ADDR  (CMD_INDEX(3) | CMD_R1)
+#define CMD_CARD_SELECT    (CMD_INDEX(7) | CMD_RSPNS_48B | CMD_CRCCHK | CMD_IXCHK)
+#define CMD_SEND_IF_COND   (CMD_INDEX(8) | CMD_R1)
+#define CMD_SET_BLOCKLEN   (CMD_INDEX(16) | CMD_R1)
+#define CMD_READ_SINGLE    (CMD_INDEX(17) | CMD_R1 | CMD_ISDATA | TM_DAT_DIR_READ)
+#define CMD_READ_MULTI     (CMD_INDEX(18) | CMD_R1 | CMD_ISDATA | TM_DAT_DIR_READ | \
+                            TM_BLKCNT_EN | TM_AUTO_CMD12 | TM_MULTI_BLOCK)
+#define CMD_WRITE_SINGLE   (CMD_INDEX(24) | CMD_R1 | CMD_ISDATA)
+#define CMD_WRITE_MULTI    (CMD_INDEX(25) | CMD_R1 | CMD_ISDATA | \
+                            TM_BLKCNT_EN | TM_AUTO_CMD12 | TM_MULTI_BLOCK)
+#define CMD_APP_CMD        (CMD_INDEX(55) | CMD_R1)
+// Application commands, sent after CMD_APP_CMD
+#define ACMD_SET_BUS_WIDTH (CMD_INDEX(6) | CMD_R1)
+#define ACMD_SEND_OP_COND  (CMD_INDEX(41) | CMD_RSPNS_48)
+
+// ACMD41 argument: high capacity support and the 2.7-3.6V window
+#define OCR_HCS          (1 << 30)
+#define OCR_VOLTAGE      0x00FF8000
+#define OCR_POWERED_UP   (1 << 31)
+#define OCR_CCS          (1 << 30)
+
+// The controller's base clock if the firmware won't tell us
+#define EMMC_DEFAULT_BASE_CLOCK 50000000
+#define EMMC_ID_CLOCK 400000
+#define EMMC_DATA_CLOCK 25000000
+
+// SLOTISR_VER host spec version field for SDHCI 3.0, which has a 10 bit clock divider
+#define HOST_SPEC_V3 2
+
+#define EMMC_TIMEOUT_US 1000000
+
+static uint32_t emmc_base_clock;
+static uint32_t emmc_host_version;
+static uint32_t emmc_rca;
+static int emmc_high_capacity;   // SDHC/SDXC cards are addressed in blocks, SDSC in bytes
+static int emmc_ready;
+
+// Wait for any of the bits in mask to be set in reg.  Returns 0 if they were, -1 on timeout
+static int emmc_wait_set(uint32_t reg, uint32_t mask)
+{
+    uint32_t start = timer_get_ticks();
+
+    while (!(mmio_read(reg) & mask)) {
+        if (timer_get_ticks() - start > EMMC_TIMEOUT_US)
+            return -1;
+    }
+    return 0;
+}
+
+// Wait for all of the bits in mask to be clear in reg
+static int emmc_wait_clear(uint32_t reg, uint32_t mask)
+{
+    uint32_t start = timer_get_ticks();
+
+    while (mmio_read(reg) & mask) {
+        if (timer_get_ticks() - start > EMMC_TIMEOUT_US)
+            return -1;
+    }
+    return 0;
+}
+
+static void emmc_reset_line(uint32_t reset)
+{
+    mmio_write(EMMC_CONTROL1, mmio_read(EMMC_CONTROL1) | reset);
+    emmc_wait_clear(EMMC_CONTROL1, reset);
+}
+
+// Wait for an interrupt status bit, acknowledging it.  On an error the command and data
+// lines are reset so the next command starts clean
+static int emmc_wait_interrupt(uint32_t mask)
+{
+    uint32_t irpt;
+
+    if (emmc_wait_set(EMMC_INTERRUPT, mask | INT_ERROR_MASK) != 0 ||
+            ((irpt = mmio_read(EMMC_INTERRUPT)) & INT_ERROR_MASK)) {
+        mmio_write(EMMC_INTERRUPT, 0xFFFFFFFF);
+        emmc_reset_line(C1_SRST_CMD | C1_SRST_DATA);
+        return -1;
+    }
+    mmio_write(EMMC_INTERRUPT, irpt & mask);
+    return 0;
+}
+
+static int emmc_command(uint32_t cmd, uint32_t arg)
+{
+    uint32_t inhibit = STATUS_CMD_INHIBIT;
+
+    if (cmd & CMD_ISDATA)
+        inhibit |= STATUS_DAT_INHIBIT;
+    if (emmc_wait_clear(EMMC_STATUS, inhibit) != 0)
+        return -1;
+
+    mmio_write(EMMC_INTERRUPT, mmio_read(EMMC_INTERRUPT));
+    mmio_write(EMMC_ARG1, arg);
+    mmio_write(EMMC_CMDTM, cmd);
+
+    return emmc_wait_interrupt(INT_CMD_DONE);
+}
+
+static int emmc_app_command(uint32_t cmd, uint32_t arg)
+{
+    if (emmc_command(CMD_APP_CMD, emmc_rca) != 0)
+        return -1;
+    return emmc_command(cmd, arg);
+}
+
+static int emmc_set_clock(uint32_t hz)
+{
+    uint32_t divisor, control;
+
+    if (emmc_wait_clear(EMMC_STATUS, STATUS_CMD_INHIBIT | STATUS_DAT_INHIBIT) != 0)
+        return -1;
+
+    // Stop the card clock while the divider changes
+    mmio_write(EMMC_CONTROL1, mmio_read(EMMC_CONTROL1) & ~C1_CLK_EN);
+    udelay(10);
+
+    if (emmc_host_version >= HOST_SPEC_V3) {
+        // SD clock = base / (2 * divisor), with a 10 bit divisor.  0 means the base clock
+        divisor = (emmc_base_clock + 2 * hz - 1) / (2 * hz);
+        if (divisor > 0x3FF)
+            divisor = 0x3FF;
+    } else {
+        // Older hosts only divide by powers of two, encoded as divisor / 2
+        for (divisor = 1; divisor < 256 && emmc_base_clock / divisor > hz; divisor <<= 1);
+        divisor >>= 1;
+    }
+
+    control = mmio_read(EMMC_CONTROL1) & ~C1_CLK_FREQ_MASK;
+    control |= ((divisor & 0xFF) << 8) | (((divisor >> 8) & 0x3) << 6);
+    mmio_write(EMMC_CONTROL1, control);
+    udelay(10);
+
+    mmio_write(EMMC_CONTROL1, control | C1_CLK_EN);
+    return emmc_wait_set(EMMC_CONTROL1, C1_CLK_STABLE);
+}
+
+int emmc_init(void)
+{
+    uint32_t start, ocr, v2_card;
+
+    emmc_ready = 0;
+    emmc_rca = 0;
+    emmc_host_version = (mmio_read(EMMC_SLOTISR_VER) >> 16) & 0xFF;
+    emmc_base_clock = mailbox_get_clock_rate(MAILBOX_CLOCK_EMMC);
+    if (emmc_base_clock == 0)
+        emmc_base_clock = EMMC_DEFAULT_BASE_CLOCK;
+
+    // Reset the host controller.  The firmware already routed GPIO 48-53 to it when it booted from the card
+    mmio_write(EMMC_CONTROL0, 0);
+    mmio_write(EMMC_CONTROL1, C1_SRST_HC);
+    if (emmc_wait_clear(EMMC_CONTROL1, C1_SRST_HC) != 0)
+        return -1;
+    mmio_write(EMMC_CONTROL1, C1_CLK_INTLEN | C1_TOUNIT_MAX);
+    udelay(10);
+
+    // Identification runs at 400 kHz
+    if (emmc_set_clock(EMMC_ID_CLOCK) != 0)
+        return -1;
+
+    // Report every interrupt in EMMC_INTERRUPT, we poll rather than take them
+    mmio_write(EMMC_IRPT_EN, 0xFFFFFFFF);
+    mmio_write(EMMC_IRPT_MASK, 0xFFFFFFFF);
+    mmio_write(EMMC_INTERRUPT, 0xFFFFFFFF);
+
+    if (emmc_command(CMD_GO_IDLE, 0) != 0)
+        return -1;
+
+    // Version 2 cards echo the check pattern back. Version 1 cards don't answer at all
+    v2_card = emmc_command(CMD_SEND_IF_COND, 0x1AA) == 0 && (mmio_read(EMMC_RESP0) & 0xFFF) == 0x1AA;
+
+    // Wait for the card to power up, telling it whether we can take a high capacity card
+    start = timer_get_ticks();
+    do {
+        if (emmc_app_command(ACMD_SEND_OP_COND, OCR_VOLTAGE | (v2_card ? OCR_HCS : 0)) != 0)
+            return -1;
+        ocr = mmio_read(EMMC_RESP0);
+        if (timer_get_ticks() - start > EMMC_TIMEOUT_US)
+            return -1;
+        if (!(ocr & OCR_POWERED_UP))
+            udelay(1000);
+    } while (!(ocr & OCR_POWERED_UP));
+    emmc_high_capacity = (ocr & OCR_CCS) != 0;
+
+    if (emmc_command(CMD_ALL_SEND_CID, 0) != 0)
+        return -1;
+    if (emmc_command(CMD_SEND_REL_ADDR, 0) != 0)
+        return -1;
+    emmc_rca = mmio_read(EMMC_RESP0) & 0xFFFF0000;
+
+    // Identification is done, the card can go full speed now
+    if (emmc_set_clock(EMMC_DATA_CLOCK) != 0)
+        return -1;
+    if (emmc_command(CMD_CARD_SELECT, emmc_rca) != 0)
+        return -1;
+
+    // Switch both ends to a 4 bit bus.  Stay at 1 bit if the card won't
+    if (emmc_app_command(ACMD_SET_BUS_WIDTH, 2) == 0)
+        mmio_write(EMMC_CONTROL0, mmio_read(EMMC_CONTROL0) | C0_HCTL_DWIDTH);
+
+    // High capacity cards always use 512 byte blocks
+    if (!emmc_high_capacity && emmc_command(CMD_SET_BLOCKLEN, EMMC_BLOCK_SIZE) != 0)
+        return -1;
+
+    emmc_ready = 1;
+    return 0;
+}
+
+// Issue a read or write for count blocks and move the data through the DATA register
+static int emmc_transfer(uint32_t lba, uint32_t count, uint8_t * buf, int write)
+{
+    uint32_t cmd, block, i, word;
+    uint32_t * wbuf;
+
+    if (!emmc_ready || count == 0 || count > EMMC_MAX_BLOCKS)
+        return -1;
+
+    if (count == 1)
+        cmd = write ? CMD_WRITE_SINGLE : CMD_READ_SINGLE;
+    else
+        cmd = write ? CMD_WRITE_MULTI : CMD_READ_MULTI;
+
+    mmio_write(EMMC_BLKSIZECNT, (count << 16) | EMMC_BLOCK_SIZE);
+    if (emmc_command(cmd, emmc_high_capacity ? lba : lba * EMMC_BLOCK_SIZE) != 0)
+        return -1;
+
+    for (block = 0; block < count; block++) {
+        if (emmc_wait_interrupt(write ? INT_WRITE_RDY : INT_READ_RDY) != 0)
+            return -1;
+
+        if (((uintptr_t)buf & 3) == 0) {
+            // Word aligned buffers move a word per register access
+            wbuf = (uint32_t *)buf;
+            for (i = 0; i < EMMC_BLOCK_SIZE / 4; i++) {
+                if (write)
+                    mmio_write(EMMC_DATA, wbuf[i]);
+                else
+                    wbuf[i] = mmio_read(EMMC_DATA);
+            }
+        } else {
+            for (i = 0; i < EMMC_BLOCK_SIZE; i += 4) {
+                if (write) {
+                    word = buf[i] | (buf[i + 1] << 8) | (buf[i + 2] << 16) | ((uint32_t)buf[i + 3] << 24);
+                    mmio_write(EMMC_DATA, word);
+                } else {
+                    word = mmio_read(EMMC_DATA);
+                    buf[i] = word;
+                    buf[i + 1] = word >> 8;
+                    buf[i + 2] = word >> 16;
+                    buf[i + 3] = word >> 24;
+                }
+            }
+        }
+        buf += EMMC_BLOCK_SIZE;
+    }
+
+    return emmc_wait_interrupt(INT_DATA_DONE);
+}
+
+int emmc_read_blocks(uint32_t lba, uint32_t count, void * buf)
+{
+    return emmc_transfer(lba, count, buf, 0);
+}
+
+int emmc_write_blocks(uint32_t lba, uint32_t count, const void * buf)
+{
+    return emmc_transfer(lba, count, (uint8_t *)buf, 1);
+}
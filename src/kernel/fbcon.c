@@ -0,0 +1,254 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/fbcon.h>
+#include <kernel/font.h>
+#include <kernel/framebuffer.h>
+#include <kernel/spinlock.h>
+#include <common/string.h>
+
+static framebuffer_t fb;
+static int fbcon_ok;
+static spinlock_t fbcon_lock;
+
+// Every glyph already in pixels.  Font rows are as wide as a cell
+static uint32_t glyph_cache[FONT_GLYPHS][FONT_HEIGHT][FONT_WIDTH];
+
+static char cells[FBCON_ROWS][FBCON_COLS];
+static uint32_t cols, rows;                 // Cells that fit on the screen we got
+static uint32_t cursor_row, cursor_col;
+static uint32_t offset;                     // Row of pixels at the top of the screen
+static int can_offset;
+static fbcon_scroll_t scroll_mode;
+
+// Cells changed since the last flush, empty when top == bottom
+static uint32_t dirty_top, dirty_bottom, dirty_left, dirty_right;
+
+static fbcon_stats_t fbcon_stats;
+
+static void fbcon_bake(uint32_t foreground, uint32_t background) {
+    uint32_t g, y, x;
+
+    for (g = 0; g < FONT_GLYPHS; g++)
+        for (y = 0; y < FONT_HEIGHT; y++)
+            for (x = 0; x < FONT_WIDTH; x++)
+                glyph_cache[g][y][x] = (font8x8[g][y] >> x) & 1 ? foreground : background;
+}
+
+static void fbcon_clear_row(uint32_t row) {
+    uint32_t col;
+
+    for (col = 0; col < FBCON_COLS; col++)
+        cells[row][col] = ' ';
+}
+
+// Add cells left to right - 1 of row to the dirty rectangle
+static void fbcon_dirty(uint32_t row, uint32_t left, uint32_t right) {
+    if (dirty_top == dirty_bottom) {
+        dirty_top = row;
+        dirty_bottom = row + 1;
+        dirty_left = left;
+        dirty_right = right;
+        return;
+    }
+    if (row < dirty_top)
+        dirty_top = row;
+    if (row >= dirty_bottom)
+        dirty_bottom = row + 1;
+    if (left < dirty_left)
+        dirty_left = left;
+    if (right > dirty_right)
+        dirty_right = right;
+}
+
+static uint32_t * fbcon_pixels(uint32_t row, uint32_t col) {
+    uint8_t * line = (uint8_t *)fb.base + (offset + row * FBCON_CELL_HEIGHT) * fb.pitch;
+
+    return (uint32_t *)line + col * FBCON_CELL_WIDTH;
+}
+
+static void fbcon_draw_cell(uint32_t row, uint32_t col) {
+    unsigned char c = cells[row][col];
+    const uint32_t * src;
+    uint32_t * dst = fbcon_pixels(row, col);
+    uint32_t y, i;
+
+    if (c < FONT_FIRST || c > FONT_LAST)
+        c = ' ';
+    src = glyph_cache[c - FONT_FIRST][0];
+    for (y = 0; y < FONT_HEIGHT; y++, src += FONT_WIDTH) {
+        for (i = 0; i < FBCON_SCALE; i++) {
+            // Spelled out, or the compiler turns the copy into a call to the byte wide memcpy
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = src[3];
+            dst[4] = src[4];
+            dst[5] = src[5];
+            dst[6] = src[6];
+            dst[7] = src[7];
+            dst = (uint32_t *)((uint8_t *)dst + fb.pitch);
+        }
+    }
+}
+
+static void fbcon_flush(void) {
+    uint32_t row, col;
+
+    if (dirty_top == dirty_bottom)
+        return;
+    for (row = dirty_top; row < dirty_bottom; row++)
+        for (col = dirty_left; col < dirty_right; col++)
+            fbcon_draw_cell(row, col);
+    fbcon_stats.cells_drawn += (dirty_bottom - dirty_top) * (dirty_right - dirty_left);
+    fbcon_stats.flushes++;
+    dirty_top = dirty_bottom = 0;
+}
+
+// Show the buffer from the top again with every cell redrawn, for when the offset is lost
+static void fbcon_redraw(void) {
+    offset = 0;
+    if (can_offset && framebuffer_set_offset(0) != 0)
+        can_offset = 0;
+    fbcon_dirty(0, 0, cols);
+    fbcon_dirty(rows - 1, 0, cols);
+}
+
+static void fbcon_scroll(void) {
+    uint8_t * base = (uint8_t *)fb.base;
+    uint32_t line = FBCON_CELL_HEIGHT * fb.pitch;   // Bytes in a line of text
+
+    // What is on screen has to be right before it moves
+    fbcon_flush();
+    if (scroll_mode == FBCON_SCROLL_OFFSET) {
+        if (offset + FBCON_CELL_HEIGHT + fb.height > fb.virtual_height) {
+            // At the end of the buffer, so back to the top with everything but the first line
+            memmove(base, base + offset * fb.pitch + line, (rows - 1) * line);
+            offset = 0;
+            fbcon_stats.moves++;
+        } else {
+            offset += FBCON_CELL_HEIGHT;
+        }
+        if (framebuffer_set_offset(offset) != 0) {
+            can_offset = 0;
+            scroll_mode = FBCON_SCROLL_MEMMOVE;
+            fbcon_redraw();
+        }
+    } else {
+        memmove(base, base + line, (rows - 1) * line);
+        fbcon_stats.moves++;
+    }
+
+    memmove(cells[0], cells[1], (rows - 1) * FBCON_COLS);
+    fbcon_clear_row(rows - 1);
+    fbcon_dirty(rows - 1, 0, cols);
+    fbcon_stats.scrolls++;
+}
+
+static void fbcon_newline(void) {
+    cursor_col = 0;
+    if (cursor_row + 1 < rows)
+        cursor_row++;
+    else
+        fbcon_scroll();
+}
+
+static void fbcon_emit(char c) {
+    switch (c) {
+    case '\n':
+        fbcon_newline();
+        break;
+    case '\r':
+        cursor_col = 0;
+        break;
+    case '\b':
+        if (cursor_col > 0)
+            cursor_col--;
+        break;
+    case '\t':
+        do
+            fbcon_emit(' ');
+        while (cursor_col % FBCON_TAB);
+        break;
+    default:
+        // Wrap only once there is something for the next line, so a full line isn't followed
+        // by an empty one
+        if (cursor_col == cols)
+            fbcon_newline();
+        cells[cursor_row][cursor_col] = c;
+        fbcon_dirty(cursor_row, cursor_col, cursor_col + 1);
+        cursor_col++;
+        break;
+    }
+}
+
+int fbcon_init(void) {
+    uint32_t row, i;
+
+    if (framebuffer_init(&fb, FBCON_WIDTH, FBCON_HEIGHT) != 0)
+        return -1;
+    spin_lock_init(&fbcon_lock, "fbcon");
+
+    cols = fb.width / FBCON_CELL_WIDTH;
+    rows = fb.height / FBCON_CELL_HEIGHT;
+    if (cols > FBCON_COLS)
+        cols = FBCON_COLS;
+    if (rows > FBCON_ROWS)
+        rows = FBCON_ROWS;
+    if (cols == 0 || rows == 0)
+        return -1;
+
+    fbcon_bake(FBCON_FOREGROUND, FBCON_BACKGROUND);
+    for (row = 0; row < FBCON_ROWS; row++)
+        fbcon_clear_row(row);
+    for (i = 0; i < fb.pitch / sizeof(uint32_t) * fb.virtual_height; i++)
+        fb.base[i] = FBCON_BACKGROUND;
+
+    can_offset = fb.virtual_height >= fb.height + FBCON_CELL_HEIGHT && framebuffer_set_offset(0) == 0;
+    scroll_mode = can_offset ? FBCON_SCROLL_OFFSET : FBCON_SCROLL_MEMMOVE;
+    fbcon_ok = 1;
+    return 0;
+}
+
+int fbcon_ready(void) {
+    return fbcon_ok;
+}
+
+void fbcon_write(const char * buf, size_t len) {
+    if (!fbcon_ok)
+        return;
+    spin_lock(&fbcon_lock);
+    fbcon_stats.chars += len;
+    while (len--)
+        fbcon_emit(*buf++);
+    fbcon_flush();
+    spin_unlock(&fbcon_lock);
+}
+
+void fbcon_putc(char c) {
+    fbcon_write(&c, 1);
+}
+
+void fbcon_puts(const char * s) {
+    fbcon_write(s, strlen(s));
+}
+
+int fbcon_set_scroll(fbcon_scroll_t mode) {
+    if (!fbcon_ok || (mode == FBCON_SCROLL_OFFSET && !can_offset))
+        return -1;
+    spin_lock(&fbcon_lock);
+    if (mode != scroll_mode) {
+        scroll_mode = mode;
+        fbcon_redraw();
+        fbcon_flush();
+    }
+    spin_unlock(&fbcon_lock);
+    return 0;
+}
+
+fbcon_scroll_t fbcon_get_scroll(void) {
+    return scroll_mode;
+}
+
+void fbcon_get_stats(fbcon_stats_t * stats) {
+    *stats = fbcon_stats;
+}
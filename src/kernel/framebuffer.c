@@ -0,0 +1,78 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/framebuffer.h>
+#include <kernel/mailbox.h>
+
+int framebuffer_init(framebuffer_t * fb, uint32_t width, uint32_t height) {
+    volatile uint32_t __attribute__((aligned(16))) buf[36];
+
+    // Every tag in one request, so the GPU sets the mode once
+    buf[0] = sizeof(buf);
+    buf[1] = MAILBOX_REQUEST;
+    buf[2] = MAILBOX_TAG_SET_PHYSICAL_SIZE;
+    buf[3] = 8;         // value buffer size
+    buf[4] = 0;         // request
+    buf[5] = width;
+    buf[6] = height;
+    buf[7] = MAILBOX_TAG_SET_VIRTUAL_SIZE;
+    buf[8] = 8;
+    buf[9] = 0;
+    buf[10] = width;
+    buf[11] = height * 2;
+    buf[12] = MAILBOX_TAG_SET_VIRTUAL_OFFSET;
+    buf[13] = 8;
+    buf[14] = 0;
+    buf[15] = 0;
+    buf[16] = 0;
+    buf[17] = MAILBOX_TAG_SET_DEPTH;
+    buf[18] = 4;
+    buf[19] = 0;
+    buf[20] = FRAMEBUFFER_DEPTH;
+    buf[21] = MAILBOX_TAG_SET_PIXEL_ORDER;
+    buf[22] = 4;
+    buf[23] = 0;
+    buf[24] = 1;        // RGB
+    buf[25] = MAILBOX_TAG_ALLOCATE_BUFFER;
+    buf[26] = 8;
+    buf[27] = 0;
+    buf[28] = 16;       // alignment in, base out
+    buf[29] = 0;        // size out
+    buf[30] = MAILBOX_TAG_GET_PITCH;
+    buf[31] = 4;
+    buf[32] = 0;
+    buf[33] = 0;
+    buf[34] = MAILBOX_TAG_END;
+    buf[35] = 0;
+
+    if (mailbox_call(MAILBOX_CHANNEL_PROPERTY, buf) != 0)
+        return -1;
+    // The firmware may pick a different size, but it has to be the depth we draw in
+    if (buf[20] != FRAMEBUFFER_DEPTH || buf[28] == 0 || buf[33] == 0)
+        return -1;
+
+    fb->base = (uint32_t *)(uintptr_t)MAILBOX_BUS_TO_PHYS(buf[28]);
+    fb->width = buf[5];
+    fb->height = buf[6];
+    fb->virtual_height = buf[11] < buf[6] ? buf[6] : buf[11];
+    fb->pitch = buf[33];
+    fb->size = buf[29];
+    return 0;
+}
+
+int framebuffer_set_offset(uint32_t y) {
+    volatile uint32_t __attribute__((aligned(16))) buf[8];
+
+    buf[0] = sizeof(buf);
+    buf[1] = MAILBOX_REQUEST;
+    buf[2] = MAILBOX_TAG_SET_VIRTUAL_OFFSET;
+    buf[3] = 8;         // value buffer size
+    buf[4] = 0;         // request
+    buf[5] = 0;
+    buf[6] = y;
+    buf[7] = MAILBOX_TAG_END;
+
+    // Out of range offsets come back clamped rather than failed
+    if (mailbox_call(MAILBOX_CHANNEL_PROPERTY, buf) != 0 || buf[6] != y)
+        return -1;
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/interrupts.h>
+#include <kernel/mmu.h>
+#include <kernel/task.h>
+#include <kernel/uart.h>
+#include <kernel/vm.h>
+#include <common/stdlib.h>
+
+static interrupt_handler_f handlers[NUM_IRQS];
+static interrupt_clearer_f clearers[NUM_IRQS];
+static volatile uint32_t irq_total;
+
+static const char * exception_names[] = {
+    "reset", "undefined instruction", "svc", "prefetch abort", "data abort", "fiq", "serror", "synchronous exception",
+};
+
+void interrupts_init(void) {
+    // Everything off until someone registers a handler
+    mmio_write(IRQ_DISABLE_1, 0xFFFFFFFF);
+    mmio_write(IRQ_DISABLE_2, 0xFFFFFFFF);
+    mmio_write(IRQ_DISABLE_BASIC, 0xFF);
+    cpu_vectors_init();
+    irq_enable();
+}
+
+void register_irq_handler(irq_number_t irq, interrupt_handler_f handler, interrupt_clearer_f clearer) {
+    uintptr_t flags;
+
+    if (irq >= NUM_IRQS)
+        return;
+    flags = irq_save();
+    handlers[irq] = handler;
+    clearers[irq] = clearer;
+    if (irq < 32)
+        mmio_write(IRQ_ENABLE_1, 1 << irq);
+    else if (irq < 64)
+        mmio_write(IRQ_ENABLE_2, 1 << (irq - 32));
+    else
+        mmio_write(IRQ_ENABLE_BASIC, 1 << (irq - 64));
+    irq_restore(flags);
+}
+
+void unregister_irq_handler(irq_number_t irq) {
+    uintptr_t flags;
+
+    if (irq >= NUM_IRQS)
+        return;
+    flags = irq_save();
+    if (irq < 32)
+        mmio_write(IRQ_DISABLE_1, 1 << irq);
+    else if (irq < 64)
+        mmio_write(IRQ_DISABLE_2, 1 << (irq - 32));
+    else
+        mmio_write(IRQ_DISABLE_BASIC, 1 << (irq - 64));
+    handlers[irq] = NULL;
+    clearers[irq] = NULL;
+    irq_restore(flags);
+}
+
+uint32_t interrupts_count(void) {
+    return irq_total;
+}
+
+static void irq_dispatch(uint32_t pending, uint32_t base) {
+    uint32_t irq;
+
+    while (pending) {
+        irq = base + __builtin_ctz(pending);
+        pending &= pending - 1;
+        if (clearers[irq])
+            clearers[irq]();
+        if (handlers[irq])
+            handlers[irq]();
+    }
+}
+
+void irq_handler(void) {
+    irq_total++;
+    // Only the low 8 bits of the basic register are interrupts of their own, the rest
+    // summarise the two banks
+    irq_dispatch(mmio_read(IRQ_PENDING_1) & mmio_read(IRQ_ENABLE_1), 0);
+    irq_dispatch(mmio_read(IRQ_PENDING_2) & mmio_read(IRQ_ENABLE_2), 32);
+    irq_dispatch(mmio_read(IRQ_BASIC_PENDING) & mmio_read(IRQ_ENABLE_BASIC) & 0xFF, 64);
+}
+
+static void panic_puts(const char * s) {
+    while (*s)
+        uart_putc_raw(*s++);
+}
+
+static void panic_puthex(uintptr_t value, int digits) {
+    while (digits--)
+        uart_putc_raw("0123456789abcdef"[(value >> (digits * 4)) & 0xF]);
+}
+
+void data_abort_handler(uintptr_t addr, uintptr_t spsr) {
+    uintptr_t fault_addr;
+    uint32_t from_user = (spsr & 0x1F) == 0x10;
+
+    // Only the kernel's own touches of vmalloc memory get mapped in
+    if (!from_user && mmu_translation_fault(&fault_addr) && vm_fault(fault_addr) == 0)
+        return;
+    exception_panic(EXCEPTION_DATA_ABORT, addr, spsr, from_user);
+}
+
+void exception_panic(uint32_t type, uintptr_t addr, uintptr_t syndrome, uint32_t from_user) {
+    const char * name = type < sizeof(exception_names) / sizeof(exception_names[0]) ? exception_names[type] : "unknown";
+    task_t * task = task_current();
+
+    // Whatever held the UART lock isn't coming back, so go straight to the hardware
+    panic_puts(from_user ? "\nTask fault: " : "\nUnhandled exception: ");
+    panic_puts(name);
+    panic_puts(" at 0x");
+    panic_puthex(addr, sizeof(addr) * 2);
+    panic_puts(", syndrome 0x");
+    panic_puthex(syndrome, 8);
+    uart_putc_raw('\n');
+
+    // The kernel itself is fine, only the task has to go
+    if (from_user && task != NULL) {
+        irq_enable();
+        task_exit(-1);
+    }
+
+    while (1)
+        asm volatile("wfe");
+}
@@ -1,10 +1,27 @@
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <kernel/uart.h>
 #include <kernel/mem.h>
+#include <kernel/printk.h>
 #include <kernel/atag.h>
+#include <kernel/ramfs.h>
+#include <kernel/spinlock.h>
+#include <kernel/trace.h>
+#include <kernel/bcache.h>
+#include <kernel/bench.h>
+#include <kernel/chainload.h>
+#include <kernel/fbcon.h>
+#include <kernel/interrupts.h>
+#include <kernel/stats.h>
+#include <kernel/task.h>
+#include <kernel/timer.h>
+#include <kernel/vdso.h>
+#include <kernel/vm.h>
 #include <common/stdio.h>
 #include <common/stdlib.h>
+#include <common/string.h>
+#include <user/programs.h>
 
 typedef struct Node {
     int data;
@@ -16,7 +33,7 @@ size_t heap_size = 0x10000;
 
 void* simplified_kmalloc(uint32_t size) {
     if (size > heap_size) {
-        puts("Out of memory\n");
+        printk(LOG_ERR, "simplified_kmalloc: out of memory for %u bytes, %u left", size, (unsigned int)heap_size);
         return NULL;
     }
     void* allocated_memory = simple_heap;
@@ -32,21 +49,21 @@ void simplified_kfree(void* ptr) {
 }
 
 void printf(const char *format, ...) {
-    char *arg_list = (char *)&format + sizeof(format); // Pointer to the arguments
+    va_list arg_list;  // The arguments.  AArch64 passes these in registers, so walk them with va_arg
     char *str_arg;     // Pointer for string arguments
     int int_arg;       // Integer argument
 
+    va_start(arg_list, format);
+
     // Iterate through the format string
     while (*format) {
         if (*format == '%' && *(format + 1)) { // Check for format specifier
             format++; // Move to the specifier character
             if (*format == 's') { // Handle %s (string)
-                str_arg = *(char **)arg_list; // Retrieve string argument
-                arg_list += sizeof(char *);  // Advance to the next argument
+                str_arg = va_arg(arg_list, char *); // Retrieve string argument
                 puts(str_arg);               // Print the string
             } else if (*format == 'd') { // Handle %d (integer)
-                int_arg = *(int *)arg_list; // Retrieve integer argument
-                arg_list += sizeof(int);   // Advance to the next argument
+                int_arg = va_arg(arg_list, int); // Retrieve integer argument
                 puts(itoa(int_arg));
             } else { // Unsupported specifier, just print as-is
                 putc('%');
@@ -57,12 +74,13 @@ void printf(const char *format, ...) {
         }
         format++; // Move to the next character
     }
+    va_end(arg_list);
 }
 
 Node *create_node(int data) {
     Node *new_node = (Node *)simplified_kmalloc(sizeof(Node));
     if (new_node == NULL) {
-        puts("Failed to allocate memory for new node\n");
+        printk(LOG_ERR, "create_node: failed to allocate memory for new node %d", data);
         return NULL;
     }
     new_node->data = data;
@@ -125,83 +143,334 @@ void clear_list(Node **head) {
     *head = NULL; // Set the head pointer to NULL
 }
 
-int custom_strcmp(const char *str1, const char *str2) {
-    while (*str1 && *str2) {
-        if (*str1 != *str2) {
-            return *str1 - *str2; // Return difference if characters don't match
+// How long the number prompts wait for a key before giving up
+#define INPUT_TIMEOUT_MS 30000
+
+// Prompt until a valid integer is entered.  Returns 0, or -1 if the user went quiet
+int validate_int(const char *prompt, int *value) {
+    char input_buf[128];
+    char *start, *end;
+    int32_t result;
+
+    while (1) {
+        puts(prompt);
+        if (gets_timeout(input_buf, sizeof(input_buf), INPUT_TIMEOUT_MS) < 0) {
+            puts("\nTimed out waiting for input.\n");
+            return -1;
+        }
+
+        // Skip leading spaces or tabs, so a blank line gets its own message
+        start = input_buf;
+        while (*start == ' ' || *start == '\t') {
+            start++;
+        }
+        if (*start == '\0') {
+            puts("Input cannot be empty or whitespace. Please enter a valid integer.\n");
+            continue;
+        }
+
+        if (strtol32(start, &end, 10, &result) == 0) {
+            // Trailing spaces are fine, anything else isn't
+            while (*end == ' ' || *end == '\t') {
+                end++;
+            }
+            if (*end == '\0') {
+                *value = result;
+                return 0;
+            }
+        } else if (end != start) {
+            puts("That number is too big. Please enter a valid integer.\n");
+            continue;
         }
-        str1++;
-        str2++;
+        puts("Invalid input. Please enter a valid integer.\n");
     }
-    // If one string ends, check if there's a difference in length
-    return *str1 - *str2;
 }
 
-int custom_atoi(const char *str) {
-    int result = 0;  // Final integer result
-    int sign = 1;    // To handle negative numbers
 
-    // Check for a negative sign at the beginning
-    if (*str == '-') {
-        sign = -1;  // Negative number
-        str++;      // Skip the negative sign
+
+// How deeply scripts may run other scripts
+#define MAX_SCRIPT_DEPTH 4
+
+static Node *head = NULL; // The LinkedList the list commands work on
+static int script_depth = 0;
+
+int execute_command(char *buf);
+
+// Run every line of a script file from the ramfs as a shell command.  Returns 1 if the script asked to exit
+int run_script(const char *path) {
+    const ramfs_file_t *file = ramfs_open(path);
+    const uint8_t *data;
+    char line[256];
+    uint32_t size, pos = 0, len;
+    int res = 0;
+
+    if (file == NULL) {
+        printf("%s: no such file\n", path);
+        return 0;
+    }
+    if (script_depth >= MAX_SCRIPT_DEPTH) {
+        printf("%s: scripts nested too deeply\n", path);
+        return 0;
     }
 
-    // Iterate through the string and convert each digit
-    while (*str >= '0' && *str <= '9') { // Check if the character is a digit
-        result = result * 10 + (*str - '0'); // Accumulate the integer value
-        str++; // Move to the next character
+    script_depth++;
+    size = ramfs_read(file, 0, file->size, &data);
+    while (pos < size && !res) {
+        // The data is read only, so each line is copied out to be parsed
+        len = 0;
+        while (pos < size && data[pos] != '\n') {
+            if (len < sizeof(line) - 1 && data[pos] != '\r') {
+                line[len++] = data[pos];
+            }
+            pos++;
+        }
+        pos++;
+        line[len] = '\0';
+
+        // Skip blank lines and comments
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        res = execute_command(line);
+    }
+    script_depth--;
+    return res;
+}
+
+void list_files(const char *dir) {
+    const ramfs_file_t *file;
+    uint32_t i, dirlen = strlen(dir);
+
+    // A trailing slash is optional
+    if (dirlen > 0 && dir[dirlen - 1] == '/') {
+        dirlen--;
     }
 
-    return result * sign; // Apply the sign to the result
+    for (i = 0; i < ramfs_count(); i++) {
+        file = ramfs_entry(i);
+        if (dirlen > 0) {
+            // Only show files below the directory
+            uint32_t j = 0;
+            while (j < dirlen && file->name[j] == dir[j]) {
+                j++;
+            }
+            if (j != dirlen || file->name[j] != '/') {
+                continue;
+            }
+        }
+        puts(RAMFS_IS_DIR(file) ? "d " : "- ");
+        puts(itoa(file->size));
+        putc('\t');
+        puts(file->name);
+        putc('\n');
+    }
 }
 
+// Parse and run one shell command.  buf is modified.  Returns 1 if the shell should exit
+int execute_command(char *buf) {
+    char command[32];
 
+    // Clear the command buffer
+    for (int i = 0; i < 32; i++) {
+        command[i] = '\0';
+    }
 
-int validate_int(const char *prompt) {
-    char input_buf[128];
-    int valid = 0;
-    int result = 0;
+    // Parse the command and arguments manually
+    int i = 0;
+    // Extract the command (up to the first space or end of string)
+    while (buf[i] != ' ' && buf[i] != '\0') {
+        if (i < 31) {
+            command[i] = buf[i];
+        }
+        i++;
+    }
 
-    while (!valid) {
-        puts(prompt);
-        gets(input_buf, sizeof(input_buf));
+    // Record the first 4 characters of the command and its length
+    trace(TRACE_SHELL_COMMAND, (uint8_t)command[0] | ((uint8_t)command[1] << 8) | ((uint8_t)command[2] << 16) | ((uint32_t)(uint8_t)command[3] << 24), i);
 
-        // Check if the input is empty or contains only whitespace
-        int i = 0;
-        while (input_buf[i] == ' ' || input_buf[i] == '\t') { // Skip leading spaces or tabs
-            i++;
+    // The rest of the line, minus leading spaces, is the argument
+    while (buf[i] == ' ') {
+        i++;
+    }
+    char *arg = &buf[i];
+
+    // Command handling
+    if (strcmp(command, "help") == 0) {
+        printf("Available commands:\n");
+        printf("help          - Show this help message\n");
+        printf("sum           - Calculate the sum of two integers\n");
+        printf("addnode       - Add an integer to the LinkedList\n");
+        printf("displaylist   - Display the content of the LinkedList\n");
+        printf("clearlist     - Clear the content of the LinkedList\n");
+        printf("ls [dir]      - List the files in the initrd\n");
+        printf("cat <file>    - Print a file from the initrd\n");
+        printf("run <file>    - Run the commands in a script from the initrd\n");
+        printf("bench [uart|sd|timers|syscalls|strings|log|console|tlb] - Run the benchmarks, all of them by default\n");
+        printf("trace [on|off|clear] - Control tracepoint recording\n");
+        printf("locks [reset] - Show lock contention counters\n");
+        printf("stats [count] - Show the last samples of the system counters, one a second\n");
+        printf("console [uart|fb|both] - Choose where output goes\n");
+        printf("dmesg [level <0-3>] - Replay the kernel log, or set the level that reaches the console\n");
+        printf("tracedump     - Stream the trace buffers over the UART (decode with tools/tracedecode.py)\n");
+        printf("spawn <program> [arg] - Queue a user task, spawn on its own lists the programs\n");
+        printf("sched         - Run the queued tasks until they all exit\n");
+        printf("chainload     - Receive a kernel or data over the UART (send with tools/chainload.py)\n");
+        printf("exit          - Exit the kernel loop\n");
+    } else if (strcmp(command, "sum") == 0) {
+        // Prompt and validate integers
+        int num1, num2;
+        if (validate_int("Enter first number: ", &num1) == 0 &&
+                validate_int("Enter second number: ", &num2) == 0) {
+            printf("The sum is: %d\n", num1 + num2);
         }
-        if (input_buf[i] == '\0') { // If after skipping spaces, it's still empty
-            puts("Input cannot be empty or whitespace. Please enter a valid integer.\n");
-            continue; // Prompt the user again
+    } else if (strcmp(command, "addnode") == 0) {
+        // Prompt and validate integer for LinkedList
+        int value;
+        if (validate_int("Enter an integer to add to the LinkedList: ", &value) == 0) {
+            head = add_node(head, value);
+            printf("Node with value %d added to the LinkedList.\n", value);
         }
-
-        // Check if the input is a valid integer
-        valid = 1;
-        if (input_buf[i] == '-') i++; // Allow negative numbers
-        for (; input_buf[i] != '\0'; i++) {
-            if (input_buf[i] < '0' || input_buf[i] > '9') {
-                valid = 0;
-                puts("Invalid input. Please enter a valid integer.\n");
-                break;
+    } else if (strcmp(command, "displaylist") == 0) {
+        display_list(head);
+    } else if (strcmp(command, "clearlist") == 0) {
+        clear_list(&head);
+    } else if (strcmp(command, "ls") == 0) {
+        list_files(arg);
+    } else if (strcmp(command, "cat") == 0) {
+        const ramfs_file_t *file = ramfs_open(arg);
+        const uint8_t *data;
+        if (file == NULL) {
+            printf("%s: no such file\n", arg);
+        } else if (RAMFS_IS_DIR(file)) {
+            printf("%s: is a directory\n", arg);
+        } else {
+            // Straight from the initrd to the console sinks, no copies
+            uint32_t size = ramfs_read(file, 0, file->size, &data);
+            write((const char *)data, size);
+        }
+    } else if (strcmp(command, "run") == 0) {
+        return run_script(arg);
+    } else if (strcmp(command, "bench") == 0) {
+        if (*arg == '\0') {
+            bench_all();
+        } else if (strcmp(arg, "uart") == 0) {
+            bench_uart();
+        } else if (strcmp(arg, "sd") == 0) {
+            bench_sd();
+        } else if (strcmp(arg, "timers") == 0) {
+            bench_timers();
+        } else if (strcmp(arg, "syscalls") == 0) {
+            bench_syscalls();
+        } else if (strcmp(arg, "strings") == 0) {
+            bench_strings();
+        } else if (strcmp(arg, "log") == 0) {
+            bench_log();
+        } else if (strcmp(arg, "console") == 0) {
+            bench_console();
+        } else if (strcmp(arg, "tlb") == 0) {
+            bench_tlb();
+        } else {
+            printf("Unknown benchmark %s\n", arg);
+        }
+    } else if (strcmp(command, "trace") == 0) {
+        if (strcmp(arg, "on") == 0) {
+            trace_enabled = 1;
+        } else if (strcmp(arg, "off") == 0) {
+            trace_enabled = 0;
+        } else if (strcmp(arg, "clear") == 0) {
+            trace_clear();
+        }
+        printf("Tracing is %s\n", trace_enabled ? "on" : "off");
+    } else if (strcmp(command, "console") == 0) {
+        uint32_t sinks = stdio_get_sinks();
+        if (strcmp(arg, "uart") == 0) {
+            sinks = STDIO_SINK_UART;
+        } else if (strcmp(arg, "fb") == 0) {
+            sinks = STDIO_SINK_FB;
+        } else if (strcmp(arg, "both") == 0) {
+            sinks = STDIO_SINK_UART | STDIO_SINK_FB;
+        }
+        if ((sinks & STDIO_SINK_FB) && !fbcon_ready()) {
+            printf("No framebuffer\n");
+        } else {
+            stdio_set_sinks(sinks);
+            printf("Console on %s\n", sinks == STDIO_SINK_UART ? "uart" : sinks == STDIO_SINK_FB ? "fb" : "uart and fb");
+        }
+    } else if (strcmp(command, "dmesg") == 0) {
+        char *num = strchr(arg, ' ');
+        uint32_t level;
+        if (num != NULL) {
+            *num++ = '\0';
+        }
+        if (*arg == '\0') {
+            log_stats_t stats;
+            printk_dump();
+            printk_get_stats(&stats);
+            printf("%d logged, %d overwritten before the console got to them, %d rate limited, %d below the console level\n",
+                   stats.written, stats.overwritten, stats.suppressed, stats.filtered);
+        } else if (strcmp(arg, "level") == 0 && num != NULL && strtoul32(num, NULL, 10, &level) == 0 && level <= LOG_DEBUG) {
+            printk_set_console_level(level);
+        } else {
+            printf("Console log level is %d\n", printk_console_level());
+        }
+    } else if (strcmp(command, "tracedump") == 0) {
+        trace_dump();
+    } else if (strcmp(command, "locks") == 0) {
+        if (strcmp(arg, "reset") == 0) {
+            lock_stats_reset();
+        }
+        for (lock_stats_t *stats = lock_stats_list(); stats != NULL; stats = stats->next) {
+            printf("%s: %d acquisitions, %d contended", stats->name, stats->acquisitions, stats->contended);
+            if (stats->acquisitions) {
+                printf(" (%d", stats->contended * 100 / stats->acquisitions);
+                puts("%)");
             }
+            printf(", %d spins\n", stats->spins);
         }
-
-        if (valid) {
-            result = custom_atoi(input_buf);
+    } else if (strcmp(command, "stats") == 0) {
+        uint32_t count = 10;
+        if (*arg && strtoul32(arg, NULL, 10, &count) != 0) {
+            printf("Not a count: %s\n", arg);
+        } else {
+            stats_print(count);
         }
+    } else if (strcmp(command, "spawn") == 0) {
+        // The program name, then an optional number for it
+        char *num = strchr(arg, ' ');
+        const user_program_t *program;
+        uint32_t value = 0;
+        int id;
+        if (num != NULL) {
+            *num++ = '\0';
+        }
+        if ((program = user_program_find(arg)) == NULL) {
+            puts("Programs:\n");
+            user_program_list();
+        } else if (num != NULL && strtoul32(num, NULL, 0, &value) != 0) {
+            printf("Not a number: %s\n", num);
+        } else if ((id = task_create(program->name, program->entry, value)) < 0) {
+            puts("Out of memory\n");
+        } else {
+            printf("[%d] %s\n", id, program->name);
+        }
+    } else if (strcmp(command, "sched") == 0) {
+        task_schedule();
+    } else if (strcmp(command, "chainload") == 0) {
+        // Only comes back on failure, or after loading data
+        chainload_status_t status = chainload();
+        if (status != CHAINLOAD_OK)
+            printf("chainload failed with status %d\n", status);
+    } else if (strcmp(command, "exit") == 0) {
+        puts("Exiting kernel loop...\n");
+        return 1;
+    } else {
+        printf("Unknown command. Type 'help' for available commands.\n");
     }
-
-    return result;
+    return 0;
 }
 
-
-
 void kernel_main(uint32_t r0, uint32_t r1, uint32_t atags) {
     char buf[256];
-    char command[32];
-    Node *head = NULL; // Initialize LinkedList
 
     // Declare as unused
     (void) r0;
@@ -210,59 +479,47 @@ void kernel_main(uint32_t r0, uint32_t r1, uint32_t atags) {
 
     // Initialize UART and memory
     uart_init();
+    printk_init();
+    trace_init();
     puts("Initializing Memory Module\n");
-    mem_init((atag_t *)atags);
+    mem_init((atag_t *)(uintptr_t)atags);
+    puts("Initializing virtual memory\n");
+    if (vm_init() != 0) {
+        puts("No page tables, addresses stay physical\n");
+    }
+    puts("Initializing Interrupts and Timers\n");
+    interrupts_init();
+    timer_init();
+    stats_init();
+    vdso_init();
+    puts("Initializing framebuffer console\n");
+    if (fbcon_init() == 0) {
+        stdio_set_sinks(STDIO_SINK_UART | STDIO_SINK_FB);
+    } else {
+        puts("No display, console on the UART only\n");
+    }
+    puts("Initializing SD card\n");
+    if (bcache_init() != 0) {
+        puts("No SD card found, block storage disabled\n");
+    }
+    if (ramfs_init((atag_t *)(uintptr_t)atags) == 0) {
+        printf("Found an initrd with %d files\n", ramfs_count());
+    }
 
     // Welcome message
     puts("CSC440 Project Fall 2024!\n");
 
+    // Let the initrd set things up
+    if (ramfs_open(RAMFS_BOOT_SCRIPT) != NULL && run_script(RAMFS_BOOT_SCRIPT)) {
+        return;
+    }
+
     while (1) {
         puts("> ");
         gets(buf, 256); // Read user input into buffer
 
-        // Clear the command buffer
-        for (int i = 0; i < 32; i++) {
-            command[i] = '\0';
-        }
-
-        // Parse the command and arguments manually
-        int i = 0;
-        // Extract the command (up to the first space or end of string)
-        while (buf[i] != ' ' && buf[i] != '\0') {
-            command[i] = buf[i];
-            i++;
-        }
-        command[i] = '\0'; // Null-terminate the command
-
-        // Command handling
-        if (custom_strcmp(command, "help") == 0) {
-            printf("Available commands:\n");
-            printf("help          - Show this help message\n");
-            printf("sum           - Calculate the sum of two integers\n");
-            printf("addnode       - Add an integer to the LinkedList\n");
-            printf("displaylist   - Display the content of the LinkedList\n");
-            printf("clearlist     - Clear the content of the LinkedList\n");
-            printf("exit          - Exit the kernel loop\n");
-        } else if (custom_strcmp(command, "sum") == 0) {
-            // Prompt and validate integers
-            int num1 = validate_int("Enter first number: ");
-            int num2 = validate_int("Enter second number: ");
-
-            printf("The sum is: %d\n", num1 + num2);
-        } else if (custom_strcmp(command, "addnode") == 0) {
-            // Prompt and validate integer for LinkedList
-            int value = validate_int("Enter an integer to add to the LinkedList: ");
-            head = add_node(head, value);
-            printf("Node with value %d added to the LinkedList.\n", value);
-        } else if (custom_strcmp(command, "displaylist") == 0) {
-            display_list(head);
-        } else if (custom_strcmp(command, "clearlist") == 0) {
-            clear_list(&head);
-        } else if (custom_strcmp(command, "exit") == 0) {
-            puts("Exiting kernel loop...\n");
+        if (execute_command(buf)) {
             break;
-        } else {
-            printf("Unknown command. Type 'help' for available commands.\n");
         }
 
         // Clear the input buffer
@@ -273,4 +530,3 @@ void kernel_main(uint32_t r0, uint32_t r1, uint32_t atags) {
         putc('\n'); // Print a newline after processing the command
     }
 }
-
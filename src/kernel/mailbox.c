@@ -0,0 +1,110 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/mailbox.h>
+#include <kernel/mmu.h>
+#include <kernel/uart.h>
+
+// Property requests go through here rather than the caller's buffer, so the cache maintenance
+// around the call covers whole lines and nothing else on the caller's stack shares them
+static uint32_t __attribute__((aligned(CACHE_LINE_SIZE))) mailbox_buffer[MAILBOX_BUFFER_WORDS];
+
+int mailbox_call(mailbox_channel_t channel, volatile uint32_t * buffer)
+{
+    volatile uint32_t * posted = buffer;
+    uint32_t message, reply, words = 0, i;
+
+    if (channel == MAILBOX_CHANNEL_PROPERTY) {
+        words = buffer[0] / sizeof(uint32_t);
+        if (words > MAILBOX_BUFFER_WORDS)
+            return -1;
+        for (i = 0; i < words; i++)
+            mailbox_buffer[i] = buffer[i];
+        // The VideoCore reads it from memory, and the lines mustn't be written back over its reply
+        dcache_clean_invalidate(mailbox_buffer, sizeof(mailbox_buffer));
+        posted = mailbox_buffer;
+    }
+
+    // The low 4 bits of a message carry the channel, so the buffer must be 16 byte aligned
+    message = (((uint32_t)(uintptr_t)posted) | MAILBOX_BUS_OFFSET) & ~0xF;
+    message |= channel;
+
+    // Wait for space in the mailbox, then post the message
+    while (mmio_read(MAIL0_STATUS) & MAILBOX_FULL);
+    mmio_write(MAIL0_WRITE, message);
+
+    // Wait for the reply addressed to us. Replies for other channels are discarded
+    while (1) {
+        while (mmio_read(MAIL0_STATUS) & MAILBOX_EMPTY);
+        reply = mmio_read(MAIL0_READ);
+        if (reply == message)
+            break;
+    }
+
+    if (channel == MAILBOX_CHANNEL_PROPERTY) {
+        // Anything speculatively fetched while the VideoCore was writing is stale
+        dcache_invalidate(mailbox_buffer, sizeof(mailbox_buffer));
+        for (i = 0; i < words; i++)
+            buffer[i] = mailbox_buffer[i];
+        if (buffer[1] != MAILBOX_RESPONSE_SUCCESS)
+            return -1;
+    }
+    return 0;
+}
+
+int mailbox_get_arm_memory(uint32_t * base, uint32_t * size)
+{
+    volatile uint32_t __attribute__((aligned(16))) buf[8];
+
+    buf[0] = sizeof(buf);
+    buf[1] = MAILBOX_REQUEST;
+    buf[2] = MAILBOX_TAG_GET_ARM_MEMORY;
+    buf[3] = 8;         // value buffer size
+    buf[4] = 0;         // request
+    buf[5] = 0;
+    buf[6] = 0;
+    buf[7] = MAILBOX_TAG_END;
+
+    if (mailbox_call(MAILBOX_CHANNEL_PROPERTY, buf) != 0)
+        return -1;
+    *base = buf[5];
+    *size = buf[6];
+    return 0;
+}
+
+uint32_t mailbox_get_clock_rate(mailbox_clock_t clock)
+{
+    volatile uint32_t __attribute__((aligned(16))) buf[8];
+
+    buf[0] = sizeof(buf);
+    buf[1] = MAILBOX_REQUEST;
+    buf[2] = MAILBOX_TAG_GET_CLOCK_RATE;
+    buf[3] = 8;         // value buffer size
+    buf[4] = 0;         // request
+    buf[5] = clock;
+    buf[6] = 0;
+    buf[7] = MAILBOX_TAG_END;
+
+    if (mailbox_call(MAILBOX_CHANNEL_PROPERTY, buf) != 0)
+        return 0;
+    return buf[6];
+}
+
+uint32_t mailbox_set_clock_rate(mailbox_clock_t clock, uint32_t rate)
+{
+    volatile uint32_t __attribute__((aligned(16))) buf[12];
+
+    buf[0] = sizeof(buf);
+    buf[1] = MAILBOX_REQUEST;
+    buf[2] = MAILBOX_TAG_SET_CLOCK_RATE;
+    buf[3] = 12;        // value buffer size
+    buf[4] = 0;         // request
+    buf[5] = clock;
+    buf[6] = rate;
+    buf[7] = 0;         // don't skip turbo settings
+    buf[8] = MAILBOX_TAG_END;
+    buf[9] = buf[10] = buf[11] = 0;
+
+    if (mailbox_call(MAILBOX_CHANNEL_PROPERTY, buf) != 0)
+        return 0;
+    return buf[6];
+}
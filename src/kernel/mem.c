@@ -1,5 +1,9 @@
 #include <kernel/mem.h>
 #include <kernel/atag.h>
+#include <kernel/mailbox.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/trace.h>
 #include <common/stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -7,7 +11,7 @@
 /**
  * Heap Stuff
  */
-static void heap_init(uint32_t heap_start);
+static void heap_init(uintptr_t heap_start);
 /**
  * impliment kmalloc as a linked list of allocated segments.
  * Segments should be 4 byte aligned.
@@ -21,6 +25,8 @@ typedef struct heap_segment{
 } heap_segment_t;
 
 static heap_segment_t * heap_segment_list_head;
+// Protects the segment list.  IRQ safe, so interrupt handlers may kmalloc
+static spinlock_t heap_lock;
 
 /**
  * End Heap Stuff
@@ -35,14 +41,22 @@ IMPLEMENT_LIST(page);
 
 static page_t * all_pages_array;
 page_list_t free_pages;
+// Protects free_pages and the page flags
+static spinlock_t page_lock;
 
 
 
 void mem_init(atag_t * atags) {
-    uint32_t mem_size, page_array_len, kernel_pages, page_array_end, i;
+    uint32_t mem_size, page_array_len, kernel_pages, i, mem_base;
+    uint32_t initrd_first = 0, initrd_last = 0;
+    uintptr_t page_array_end;
+    initrd2_t * initrd;
 
-    // Get the total number of pages
+    // Get the total number of pages.  Without ATAGS (the 64 bit boot path, or a bootloader that
+    // doesn't pass them) ask the firmware instead
     mem_size = get_mem_size(atags);
+    if (mem_size == 0 && mailbox_get_arm_memory(&mem_base, &mem_size) != 0)
+        mem_size = 0;
     num_pages = mem_size / PAGE_SIZE;
 
     // Allocate space for all those pages' metadata.  Start this block just after the kernel image is finished
@@ -50,10 +64,14 @@ void mem_init(atag_t * atags) {
     all_pages_array = (page_t *)&__end;
     bzero(all_pages_array, page_array_len);
     INITIALIZE_LIST(free_pages);
+    spin_lock_init(&page_lock, "page allocator");
 
     // Iterate over all pages and mark them with the appropriate flags
-    // Start with kernel pages
-    kernel_pages = ((uint32_t)&__end) / PAGE_SIZE;
+    // Start with kernel pages.  The page metadata array counts as part of the kernel, and the
+    // heap starts on the page boundary after it
+    page_array_end = (uintptr_t)&__end + page_array_len;
+    page_array_end += page_array_end % PAGE_SIZE ? PAGE_SIZE - (page_array_end % PAGE_SIZE) : 0;
+    kernel_pages = page_array_end / PAGE_SIZE;
     for (i = 0; i < kernel_pages; i++) {
         all_pages_array[i].vaddr_mapped = i * PAGE_SIZE;    // Identity map the kernel pages
         all_pages_array[i].flags.allocated = 1;
@@ -65,15 +83,27 @@ void mem_init(atag_t * atags) {
         all_pages_array[i].flags.allocated = 1;
         all_pages_array[i].flags.kernel_heap_page = 1;
     }
+    // The initrd is used in place by the ramfs, so keep its pages off the free list
+    initrd = get_initrd(atags);
+    if (initrd != NULL) {
+        initrd_first = initrd->start / PAGE_SIZE;
+        initrd_last = (initrd->start + initrd->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
     // Map the rest of the pages as unallocated, and add them to the free list
     for(; i < num_pages; i++){
+        if (i >= initrd_first && i < initrd_last) {
+            all_pages_array[i].vaddr_mapped = i * PAGE_SIZE;
+            all_pages_array[i].flags.allocated = 1;
+            all_pages_array[i].flags.initrd_page = 1;
+            continue;
+        }
+        all_pages_array[i].vaddr_mapped = i * PAGE_SIZE;
         all_pages_array[i].flags.allocated = 0;
         append_page_list(&free_pages, &all_pages_array[i]);
     }
 
 
     // Initialize the heap
-    page_array_end = (uint32_t)&__end + page_array_len;
     heap_init(page_array_end);
 
 }
@@ -81,52 +111,152 @@ void mem_init(atag_t * atags) {
 void * alloc_page(void) {
     page_t * page;
     void * page_mem;
+    uintptr_t flags;
 
-
-    if (size_page_list(&free_pages) == 0)
+    flags = spin_lock_irqsave(&page_lock);
+    if (size_page_list(&free_pages) == 0) {
+        spin_unlock_irqrestore(&page_lock, flags);
+        printk(LOG_WARN, "alloc_page: out of pages");
         return 0;
+    }
 
     // Get a free page
     page = pop_page_list(&free_pages);
     page->flags.kernel_page = 1;
     page->flags.allocated = 1;
+    spin_unlock_irqrestore(&page_lock, flags);
 
     // Get the address the physical page metadata refers to
-    page_mem = (void *)((page - all_pages_array) * PAGE_SIZE);
+    page_mem = (void *)((uintptr_t)(page - all_pages_array) * PAGE_SIZE);
 
     // Zero out the page, big security flaw to not do this :)
     bzero(page_mem, PAGE_SIZE);
 
+    trace(TRACE_ALLOC_PAGE, (uintptr_t)page_mem, 0);
     return page_mem;
 }
 
+// Take count free pages starting at page first off the free list.  Called with page_lock held
+static void take_pages(uint32_t first, uint32_t count) {
+    uint32_t i;
+
+    for (i = first; i < first + count; i++) {
+        remove_page_list(&free_pages, &all_pages_array[i]);
+        all_pages_array[i].flags.kernel_page = 1;
+        all_pages_array[i].flags.allocated = 1;
+    }
+}
+
+static void * zero_pages(uint32_t first, uint32_t count) {
+    void * addr = (void *)((uintptr_t)first * PAGE_SIZE);
+    uint32_t i;
+
+    bzero(addr, count * PAGE_SIZE);
+    for (i = 0; i < count; i++)
+        trace(TRACE_ALLOC_PAGE, (uintptr_t)addr + i * PAGE_SIZE, 0);
+    return addr;
+}
+
+void * alloc_pages_at(void * addr, uint32_t count) {
+    uint32_t first = (uintptr_t)addr / PAGE_SIZE, i;
+    uintptr_t flags;
+
+    if ((uintptr_t)addr % PAGE_SIZE || first + count > num_pages || first + count < first)
+        return NULL;
+
+    flags = spin_lock_irqsave(&page_lock);
+    for (i = first; i < first + count; i++) {
+        if (all_pages_array[i].flags.allocated) {
+            spin_unlock_irqrestore(&page_lock, flags);
+            return NULL;
+        }
+    }
+    take_pages(first, count);
+    spin_unlock_irqrestore(&page_lock, flags);
+
+    return zero_pages(first, count);
+}
+
+void * alloc_pages(uint32_t count) {
+    return alloc_pages_aligned(count, 1);
+}
+
+void * alloc_pages_aligned(uint32_t count, uint32_t align) {
+    uint32_t i, run = 0;
+    uintptr_t flags;
+
+    if (count == 0 || align == 0 || (align & (align - 1)))
+        return NULL;
+
+    // First fit over the page array, with runs only starting on an aligned page.  Slow next to
+    // alloc_page, but this is for the rare allocation that needs physically contiguous memory
+    flags = spin_lock_irqsave(&page_lock);
+    for (i = 0; i < num_pages; i++) {
+        if (run == 0 && i % align) {
+            continue;
+        } else if (all_pages_array[i].flags.allocated) {
+            run = 0;
+        } else if (++run == count) {
+            take_pages(i + 1 - count, count);
+            spin_unlock_irqrestore(&page_lock, flags);
+            return zero_pages(i + 1 - count, count);
+        }
+    }
+    spin_unlock_irqrestore(&page_lock, flags);
+    return NULL;
+}
+
 void free_page(void * ptr) {
     page_t * page;
+    uintptr_t flags;
+
+    trace(TRACE_FREE_PAGE, (uintptr_t)ptr, 0);
 
     // Get page metadata from the physical address
-    page = all_pages_array + ((uint32_t)ptr / PAGE_SIZE);
+    page = all_pages_array + ((uintptr_t)ptr / PAGE_SIZE);
 
     // Mark the page as free
+    flags = spin_lock_irqsave(&page_lock);
     page->flags.allocated = 0;
     append_page_list(&free_pages, page);
+    spin_unlock_irqrestore(&page_lock, flags);
+}
+
+uint32_t mem_free_pages(void) {
+    return size_page_list(&free_pages);
+}
+
+uint32_t mem_num_pages(void) {
+    return num_pages;
+}
+
+page_t * mem_page(uintptr_t addr) {
+    if (addr / PAGE_SIZE >= num_pages)
+        return NULL;
+    return &all_pages_array[addr / PAGE_SIZE];
 }
 
 
-static void heap_init(uint32_t heap_start) {
+static void heap_init(uintptr_t heap_start) {
    heap_segment_list_head = (heap_segment_t *) heap_start;
    bzero(heap_segment_list_head, sizeof(heap_segment_t));
    heap_segment_list_head->segment_size = KERNEL_HEAP_SIZE;
+   spin_lock_init(&heap_lock, "kernel heap");
 }
 
 
 void * kmalloc(uint32_t bytes) {
     heap_segment_t * curr, *best = NULL;
     int diff, best_diff = 0x7fffffff; // Max signed int
+    uint32_t requested = bytes;
+    uintptr_t flags;
 
     // Add the header to the number of bytes we need and make the size 4 byte aligned
     bytes += sizeof(heap_segment_t);
     bytes += bytes % 16 ? 16 - (bytes % 16) : 0;
 
+    flags = spin_lock_irqsave(&heap_lock);
+
     // Find the allocation that is closest in size to this request
     for (curr = heap_segment_list_head; curr != NULL; curr = curr->next) {
         diff = curr->segment_size - bytes;
@@ -137,8 +267,12 @@ void * kmalloc(uint32_t bytes) {
     }
 
     // There must be no free memory right now :(
-    if (best == NULL)
+    if (best == NULL) {
+        spin_unlock_irqrestore(&heap_lock, flags);
+        trace(TRACE_KMALLOC, requested, 0);
+        printk(LOG_WARN, "kmalloc: no free segment for %u bytes", requested);
         return NULL;
+    }
 
     // If the best difference we could come up with was large, split up this segment into two.
     // Since our segment headers are rather large, the criterion for splitting the segment is that
@@ -149,35 +283,47 @@ void * kmalloc(uint32_t bytes) {
         best->next = ((void*)(best)) + bytes;
         best->next->next = curr;
         best->next->prev = best;
+        if (curr != NULL)
+            curr->prev = best->next;
         best->next->segment_size = best->segment_size - bytes;
         best->segment_size = bytes;
     }
 
     best->is_allocated = 1;
+    spin_unlock_irqrestore(&heap_lock, flags);
 
+    trace(TRACE_KMALLOC, requested, (uintptr_t)(best + 1));
     return best + 1;
 }
 
 void kfree(void *ptr) {
-    heap_segment_t * seg;
+    heap_segment_t * seg, * right;
+    uintptr_t flags;
 
     if (!ptr)
         return;
 
+    trace(TRACE_KFREE, (uintptr_t)ptr, 0);
+
     seg = ptr - sizeof(heap_segment_t);
+    flags = spin_lock_irqsave(&heap_lock);
     seg->is_allocated = 0;
 
     // try to coalesce segements to the left
     while(seg->prev != NULL && !seg->prev->is_allocated) {
         seg->prev->next = seg->next;
-        seg->next->prev = seg->prev;
+        if (seg->next != NULL)
+            seg->next->prev = seg->prev;
         seg->prev->segment_size += seg->segment_size;
         seg = seg->prev;
     }
     // try to coalesce segments to the right
     while(seg->next != NULL && !seg->next->is_allocated) {
-        seg->next->next->prev = seg;
-        seg->next = seg->next->next;
-        seg->segment_size += seg->next->segment_size;
+        right = seg->next;
+        seg->segment_size += right->segment_size;
+        seg->next = right->next;
+        if (seg->next != NULL)
+            seg->next->prev = seg;
     }
+    spin_unlock_irqrestore(&heap_lock, flags);
 }
@@ -0,0 +1,238 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/atomic.h>
+#include <kernel/cpu.h>
+#include <kernel/fbcon.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <kernel/uart.h>
+#include <common/stdio.h>
+#include <common/string.h>
+
+static const char * level_names[] = { "err", "warn", "info", "debug" };
+
+// Long enough for a timestamp, a level and a full record, plus the suppressed note in front
+#define LOG_LINE_LEN (LOG_TEXT_LEN + 64)
+
+static log_record_t log_ring[LOG_RING_SIZE];
+static volatile uint32_t log_head;          // Records ever claimed
+static volatile uint32_t log_overwritten;
+static log_level_t console_level = LOG_DEFAULT_CONSOLE_LEVEL;
+
+// Console state, only touched with log_drain_lock held
+static spinlock_t log_drain_lock;
+static uint32_t console_next;               // Next record for the console
+static char console_line[LOG_LINE_LEN];
+static uint32_t console_len, console_sent;  // Line being written out, and how far we got
+static uint32_t console_tokens = LOG_CONSOLE_BURST;
+static uint32_t console_refilled;           // Tick the tokens were last topped up
+static uint32_t console_suppressed, console_suppressed_total, console_filtered;
+
+// Append up to len characters of s at pos, returning the new position
+static uint32_t log_append(char * buf, uint32_t pos, uint32_t size, const char * s, uint32_t len) {
+    while (len-- && pos < size && *s)
+        buf[pos++] = *s++;
+    return pos;
+}
+
+// The little bit of printf the kernel needs, into a fixed size buffer
+static uint32_t log_format(char * buf, uint32_t size, const char * format, va_list args) {
+    char num[ITOA_BUF_SIZE];
+    uint32_t pos = 0;
+
+    for (; *format && pos < size; format++) {
+        if (*format != '%' || format[1] == '\0') {
+            buf[pos++] = *format;
+            continue;
+        }
+        switch (*++format) {
+        case 's':
+            pos = log_append(buf, pos, size, va_arg(args, const char *), size);
+            break;
+        case 'd':
+            pos = log_append(buf, pos, size, num, itoa_r(va_arg(args, int), num));
+            break;
+        case 'u':
+            pos = log_append(buf, pos, size, num, utoa_r(va_arg(args, unsigned int), num));
+            break;
+        case 'x': {
+            unsigned int value = va_arg(args, unsigned int);
+            int digits = 1;
+            while (digits < 8 && value >> (digits * 4))
+                digits++;
+            while (digits-- && pos < size)
+                buf[pos++] = "0123456789abcdef"[(value >> (digits * 4)) & 0xF];
+            break;
+        }
+        default:
+            buf[pos++] = *format;
+            break;
+        }
+    }
+    return pos;
+}
+
+void printk_init(void) {
+    spin_lock_init(&log_drain_lock, "printk drain");
+    console_refilled = timer_get_tick_count();
+}
+
+void printk(log_level_t level, const char * format, ...) {
+    uint32_t index = atomic_fetch_add(&log_head, 1);
+    log_record_t * rec = &log_ring[index % LOG_RING_SIZE];
+    va_list args;
+
+    // Unpublish the record first, so a reader can't take it for the old one half overwritten
+    rec->seq = 0;
+    dmb();
+    rec->level = level;
+    rec->cpu = cpu_id();
+    rec->timestamp = timer_get_ticks64();
+    va_start(args, format);
+    rec->len = log_format(rec->text, LOG_TEXT_LEN, format, args);
+    va_end(args);
+    dmb();
+    rec->seq = index + 1;
+}
+
+// Copy out record index.  Returns 1 on success, 0 if it isn't published yet, and -1 if it has
+// been overwritten by a newer one
+static int log_read(uint32_t index, log_record_t * copy) {
+    const log_record_t * rec = &log_ring[index % LOG_RING_SIZE];
+    uint32_t seq = rec->seq;
+
+    if (seq != index + 1)
+        return seq == 0 || seq - (index + 1) >= 0x80000000 ? 0 : -1;
+    dmb();
+    *copy = *rec;
+    dmb();
+    return rec->seq == seq ? 1 : -1;
+}
+
+// Right align value in width characters, padding with pad
+static uint32_t log_append_padded(char * buf, uint32_t pos, uint32_t value, int width, char pad) {
+    char num[UTOA_BUF_SIZE];
+    int len = utoa_r(value, num);
+
+    for (; width > len; width--)
+        buf[pos++] = pad;
+    return log_append(buf, pos, LOG_LINE_LEN, num, len);
+}
+
+// "[    1.234567] err: text\n"
+static uint32_t log_line(const log_record_t * rec, char * buf, uint32_t pos) {
+    buf[pos++] = '[';
+    pos = log_append_padded(buf, pos, rec->timestamp / 1000000, 5, ' ');
+    buf[pos++] = '.';
+    pos = log_append_padded(buf, pos, rec->timestamp % 1000000, 6, '0');
+    pos = log_append(buf, pos, LOG_LINE_LEN, "] ", 2);
+    pos = log_append(buf, pos, LOG_LINE_LEN, level_names[rec->level & 3], 5);
+    pos = log_append(buf, pos, LOG_LINE_LEN, ": ", 2);
+    pos = log_append(buf, pos, LOG_LINE_LEN, rec->text, rec->len);
+    buf[pos++] = '\n';
+    return pos;
+}
+
+// Let one more line through the rate limit, if there is a token for it
+static int console_take_token(void) {
+    uint32_t now = timer_get_tick_count(), earned;
+
+    earned = (now - console_refilled) * TIMER_TICK_MS * LOG_CONSOLE_RATE / 1000;
+    if (earned > 0) {
+        console_tokens += earned;
+        if (console_tokens > LOG_CONSOLE_BURST)
+            console_tokens = LOG_CONSOLE_BURST;
+        console_refilled = now;
+    }
+    if (console_tokens == 0)
+        return 0;
+    console_tokens--;
+    return 1;
+}
+
+void printk_drain(void) {
+    log_record_t rec;
+    uint32_t head, pos, sinks;
+    int res;
+
+    if (!spin_trylock(&log_drain_lock))
+        return;
+    while (1) {
+        // Finish the line in flight first
+        if (console_sent < console_len) {
+            console_sent += uart_try_write(console_line + console_sent, console_len - console_sent);
+            if (console_sent < console_len)
+                break;
+        }
+
+        head = atomic_load(&log_head);
+        if (console_next == head)
+            break;
+        if (head - console_next > LOG_RING_SIZE) {
+            log_overwritten += head - console_next - LOG_RING_SIZE;
+            console_next = head - LOG_RING_SIZE;
+        }
+        if ((res = log_read(console_next, &rec)) == 0)
+            break;
+        console_next++;
+        if (res < 0) {
+            log_overwritten++;
+            continue;
+        }
+
+        if (rec.level > console_level) {
+            console_filtered++;
+            continue;
+        }
+        if (!console_take_token()) {
+            console_suppressed++;
+            console_suppressed_total++;
+            continue;
+        }
+        pos = 0;
+        if (console_suppressed) {
+            pos = log_append(console_line, pos, LOG_LINE_LEN, "(", 1);
+            pos = log_append_padded(console_line, pos, console_suppressed, 0, ' ');
+            pos = log_append(console_line, pos, LOG_LINE_LEN, " messages suppressed)\n", 22);
+            console_suppressed = 0;
+        }
+        console_len = log_line(&rec, console_line, pos);
+        console_sent = 0;
+        // The screen takes the whole line now, the UART as its FIFO frees up
+        sinks = stdio_get_sinks();
+        if (sinks & STDIO_SINK_FB)
+            fbcon_write(console_line, console_len);
+        if (!(sinks & STDIO_SINK_UART))
+            console_sent = console_len;
+    }
+    spin_unlock(&log_drain_lock);
+}
+
+void printk_dump(void) {
+    char line[LOG_LINE_LEN];
+    log_record_t rec;
+    uint32_t head = atomic_load(&log_head), index;
+
+    index = head > LOG_RING_SIZE ? head - LOG_RING_SIZE : 0;
+    for (; index != head; index++) {
+        if (log_read(index, &rec) > 0)
+            write(line, log_line(&rec, line, 0));
+    }
+}
+
+void printk_set_console_level(log_level_t level) {
+    console_level = level;
+}
+
+log_level_t printk_console_level(void) {
+    return console_level;
+}
+
+void printk_get_stats(log_stats_t * stats) {
+    stats->written = log_head;
+    stats->overwritten = log_overwritten;
+    stats->suppressed = console_suppressed_total;
+    stats->filtered = console_filtered;
+}
@@ -0,0 +1,209 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/atag.h>
+#include <kernel/mem.h>
+#include <kernel/ramfs.h>
+#include <common/stdlib.h>
+
+/**
+ * newc cpio archives are a list of entries, each a 110 byte ASCII header, the NUL terminated name,
+ * padding to 4 bytes, the file data, and padding to 4 bytes again.  A file named TRAILER!!! ends it.
+ * Every number in the header is 8 hex digits.
+ */
+#define CPIO_HEADER_SIZE 110
+#define CPIO_MAGIC "070701"
+#define CPIO_TRAILER "TRAILER!!!"
+
+#define CPIO_FIELD_MODE     1
+#define CPIO_FIELD_MTIME    5
+#define CPIO_FIELD_FILESIZE 6
+#define CPIO_FIELD_NAMESIZE 11
+
+#define CPIO_ALIGN(x) (((x) + 3) & ~3)
+
+static ramfs_file_t * ramfs_files;
+static uint32_t ramfs_num_files;
+// Open addressed hash table of name -> file, at least twice as big as the file count
+static ramfs_file_t ** ramfs_table;
+static uint32_t ramfs_table_mask;
+
+static uint32_t cpio_field(const uint8_t * header, int field) {
+    const uint8_t * s = header + 6 + field * 8;
+    uint32_t value = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        value <<= 4;
+        if (s[i] >= '0' && s[i] <= '9')
+            value |= s[i] - '0';
+        else if (s[i] >= 'a' && s[i] <= 'f')
+            value |= s[i] - 'a' + 10;
+        else if (s[i] >= 'A' && s[i] <= 'F')
+            value |= s[i] - 'A' + 10;
+    }
+    return value;
+}
+
+static int ramfs_streq(const char * a, const char * b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// Paths are looked up without any leading "./" or "/", so "/etc/rc", "./etc/rc" and "etc/rc" match
+static const char * ramfs_skip_prefix(const char * path) {
+    while (1) {
+        if (path[0] == '/')
+            path++;
+        else if (path[0] == '.' && path[1] == '/')
+            path += 2;
+        else
+            return path;
+    }
+}
+
+// FNV-1a
+static uint32_t ramfs_hash(const char * s) {
+    uint32_t hash = 2166136261u;
+
+    while (*s) {
+        hash ^= (uint8_t)*s++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Walk the archive.  With files == NULL only count the entries
+static int ramfs_scan(const uint8_t * archive, uint32_t size, ramfs_file_t * files, uint32_t * count) {
+    const uint8_t * header = archive, * end = archive + size;
+    const char * name;
+    uint32_t namesize, filesize, data, n = 0;
+    int i;
+
+    while ((uint32_t)(header - archive) <= size && size - (header - archive) >= CPIO_HEADER_SIZE) {
+        for (i = 0; i < 6; i++) {
+            if (header[i] != CPIO_MAGIC[i])
+                return -1;
+        }
+        namesize = cpio_field(header, CPIO_FIELD_NAMESIZE);
+        filesize = cpio_field(header, CPIO_FIELD_FILESIZE);
+        name = (const char *)header + CPIO_HEADER_SIZE;
+        // Sizes are checked against what is left, so huge ones can't wrap the pointers around
+        if (namesize == 0 || namesize > (uint32_t)(end - (const uint8_t *)name) || name[namesize - 1] != '\0')
+            return -1;
+        if (ramfs_streq(name, CPIO_TRAILER))
+            break;
+        data = CPIO_ALIGN((header - archive) + CPIO_HEADER_SIZE + namesize);
+        if (data > size || filesize > size - data)
+            return -1;
+
+        name = ramfs_skip_prefix(name);
+        // The root directory itself, "." in most archives, isn't worth an entry
+        if (*name != '\0' && !ramfs_streq(name, ".")) {
+            if (files != NULL) {
+                files[n].name = name;
+                files[n].data = archive + data;
+                files[n].size = filesize;
+                files[n].mode = cpio_field(header, CPIO_FIELD_MODE);
+                files[n].mtime = cpio_field(header, CPIO_FIELD_MTIME);
+                files[n].hash = ramfs_hash(name);
+            }
+            n++;
+        }
+
+        header = archive + CPIO_ALIGN(data + filesize);
+    }
+
+    *count = n;
+    return 0;
+}
+
+int ramfs_init(atag_t * atags) {
+    initrd2_t * initrd = get_initrd(atags);
+    const uint8_t * archive;
+    uint32_t count, table_size, i, slot;
+
+    if (initrd == NULL)
+        return -1;
+    archive = (const uint8_t *)(uintptr_t)initrd->start;
+
+    // Count first so the index can be allocated in one go
+    if (ramfs_scan(archive, initrd->size, NULL, &count) != 0 || count == 0)
+        return -1;
+
+    for (table_size = 16; table_size < count * 2; table_size <<= 1);
+    ramfs_files = kmalloc(sizeof(ramfs_file_t) * count);
+    ramfs_table = kmalloc(sizeof(ramfs_file_t *) * table_size);
+    if (!ramfs_files || !ramfs_table) {
+        kfree(ramfs_files);
+        kfree(ramfs_table);
+        ramfs_files = NULL;
+        ramfs_table = NULL;
+        return -1;
+    }
+    bzero(ramfs_table, sizeof(ramfs_file_t *) * table_size);
+    ramfs_table_mask = table_size - 1;
+
+    ramfs_scan(archive, initrd->size, ramfs_files, &count);
+    ramfs_num_files = count;
+
+    // Linear probing.  The table is at most half full, so chains stay short.  A later entry for
+    // the same name replaces the earlier one, like extracting the archive would
+    for (i = 0; i < count; i++) {
+        slot = ramfs_files[i].hash & ramfs_table_mask;
+        while (ramfs_table[slot] != NULL &&
+                !(ramfs_table[slot]->hash == ramfs_files[i].hash && ramfs_streq(ramfs_table[slot]->name, ramfs_files[i].name)))
+            slot = (slot + 1) & ramfs_table_mask;
+        ramfs_table[slot] = &ramfs_files[i];
+    }
+
+    return 0;
+}
+
+const ramfs_file_t * ramfs_open(const char * path) {
+    uint32_t hash, slot;
+    const ramfs_file_t * file;
+
+    if (ramfs_table == NULL)
+        return NULL;
+
+    path = ramfs_skip_prefix(path);
+    hash = ramfs_hash(path);
+    for (slot = hash & ramfs_table_mask; (file = ramfs_table[slot]) != NULL; slot = (slot + 1) & ramfs_table_mask) {
+        if (file->hash == hash && ramfs_streq(file->name, path))
+            return file;
+    }
+    return NULL;
+}
+
+uint32_t ramfs_read(const ramfs_file_t * file, uint32_t offset, uint32_t len, const uint8_t ** data) {
+    if (offset >= file->size) {
+        *data = file->data + file->size;
+        return 0;
+    }
+    if (len > file->size - offset)
+        len = file->size - offset;
+    *data = file->data + offset;
+    return len;
+}
+
+int ramfs_stat(const char * path, ramfs_stat_t * st) {
+    const ramfs_file_t * file = ramfs_open(path);
+
+    if (file == NULL)
+        return -1;
+    st->size = file->size;
+    st->mode = file->mode;
+    st->mtime = file->mtime;
+    return 0;
+}
+
+uint32_t ramfs_count(void) {
+    return ramfs_num_files;
+}
+
+const ramfs_file_t * ramfs_entry(uint32_t i) {
+    return i < ramfs_num_files ? &ramfs_files[i] : NULL;
+}
@@ -0,0 +1,147 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/atomic.h>
+#include <kernel/cpu.h>
+#include <kernel/spinlock.h>
+
+#define RWLOCK_WRITER 0x80000000
+
+static lock_stats_t * registered_locks;
+static spinlock_t registry_lock;
+
+static void lock_register(lock_stats_t * stats, const char * name) {
+    stats->name = name;
+    stats->acquisitions = 0;
+    stats->contended = 0;
+    stats->spins = 0;
+
+    spin_lock(&registry_lock);
+    stats->next = registered_locks;
+    registered_locks = stats;
+    spin_unlock(&registry_lock);
+}
+
+void spin_lock_init(spinlock_t * lock, const char * name) {
+    lock->value = 0;
+    lock_register(&lock->stats, name);
+}
+
+void spin_lock(spinlock_t * lock) {
+    uint32_t ticket, spins = 0;
+
+    ticket = atomic_fetch_add(&lock->value, 1 << 16) >> 16;
+
+    // Sleep until the holder's unlock sends an event
+    while (lock->owner != (uint16_t)ticket) {
+        wfe();
+        spins++;
+    }
+    dmb();
+
+    // We own the lock, so the plain increments are safe
+    lock->stats.acquisitions++;
+    if (spins) {
+        lock->stats.contended++;
+        lock->stats.spins += spins;
+    }
+}
+
+int spin_trylock(spinlock_t * lock) {
+    uint32_t value = lock->value;
+
+    // Free means owner == next, in which case drawing the next ticket takes the lock
+    if ((value & 0xFFFF) != (value >> 16))
+        return 0;
+    if (atomic_cas(&lock->value, value, value + (1 << 16)) != value)
+        return 0;
+
+    lock->stats.acquisitions++;
+    return 1;
+}
+
+void spin_unlock(spinlock_t * lock) {
+    // Only the holder writes owner.  The halfword store also breaks any exclusive access
+    // another core has open on the word, so its ticket increment retries
+    dmb();
+    lock->owner++;
+    dsb();
+    sev();
+}
+
+uintptr_t spin_lock_irqsave(spinlock_t * lock) {
+    uintptr_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t * lock, uintptr_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+void rwlock_init(rwlock_t * lock, const char * name) {
+    lock->value = 0;
+    lock_register(&lock->stats, name);
+}
+
+void read_lock(rwlock_t * lock) {
+    uint32_t value, spins = 0;
+
+    while (1) {
+        value = lock->value & ~RWLOCK_WRITER;
+        // Only succeeds if there was no writer and no other reader came or went in between
+        if (atomic_cas(&lock->value, value, value + 1) == value)
+            break;
+        if (lock->value & RWLOCK_WRITER)
+            wfe();
+        spins++;
+    }
+
+    // Readers run concurrently, so the counters need atomic updates
+    atomic_fetch_add(&lock->stats.acquisitions, 1);
+    if (spins) {
+        atomic_fetch_add(&lock->stats.contended, 1);
+        atomic_fetch_add(&lock->stats.spins, spins);
+    }
+}
+
+void read_unlock(rwlock_t * lock) {
+    atomic_fetch_add(&lock->value, (uint32_t)-1);
+    dsb();
+    sev();
+}
+
+void write_lock(rwlock_t * lock) {
+    uint32_t spins = 0;
+
+    while (atomic_cas(&lock->value, 0, RWLOCK_WRITER) != 0) {
+        wfe();
+        spins++;
+    }
+
+    lock->stats.acquisitions++;
+    if (spins) {
+        lock->stats.contended++;
+        lock->stats.spins += spins;
+    }
+}
+
+void write_unlock(rwlock_t * lock) {
+    atomic_store(&lock->value, 0);
+    dsb();
+    sev();
+}
+
+lock_stats_t * lock_stats_list(void) {
+    return registered_locks;
+}
+
+void lock_stats_reset(void) {
+    lock_stats_t * stats;
+
+    for (stats = registered_locks; stats != NULL; stats = stats->next) {
+        stats->acquisitions = 0;
+        stats->contended = 0;
+        stats->spins = 0;
+    }
+}
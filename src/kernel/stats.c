@@ -0,0 +1,86 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/interrupts.h>
+#include <kernel/mem.h>
+#include <kernel/stats.h>
+#include <kernel/timer.h>
+#include <common/stdio.h>
+#include <common/stdlib.h>
+
+static stats_sample_t stats_ring[STATS_SAMPLES];
+static uint32_t stats_taken;
+static timer_t stats_timer;
+
+// Runs in interrupt context off the periodic timer
+static void stats_sample(void * data) {
+    stats_sample_t * sample = &stats_ring[stats_taken % STATS_SAMPLES];
+    timer_stats_t timers;
+
+    (void) data;
+    timer_get_stats(&timers);
+    sample->tick = timer_get_tick_count();
+    sample->free_pages = mem_free_pages();
+    sample->pending_timers = timers.pending;
+    sample->interrupts = interrupts_count();
+    sample->timer_callbacks = timers.expired;
+    stats_taken++;
+}
+
+void stats_init(void) {
+    timer_setup(&stats_timer, stats_sample, NULL);
+    timer_add_periodic(&stats_timer, STATS_PERIOD_MS);
+}
+
+static void stats_print_col(uint32_t value, int width) {
+    const char * s = itoa(value);
+    const char * end = s;
+
+    while (*end)
+        end++;
+    for (width -= end - s; width > 0; width--)
+        putc(' ');
+    puts(s);
+}
+
+// Per second rate of a running total between two samples
+static uint32_t stats_rate(uint32_t now, uint32_t then, uint32_t ticks) {
+    return ticks ? (uint64_t)(now - then) * 1000 / (ticks * TIMER_TICK_MS) : 0;
+}
+
+void stats_print(uint32_t count) {
+    static stats_sample_t samples[STATS_SAMPLES];
+    uint32_t taken, first, i;
+    uintptr_t flags;
+
+    // Copy them out with the sampler held off, so none changes half way through
+    flags = irq_save();
+    taken = stats_taken;
+    for (i = 0; i < STATS_SAMPLES; i++)
+        samples[i] = stats_ring[i];
+    irq_restore(flags);
+
+    if (taken < 2) {
+        puts("No samples yet\n");
+        return;
+    }
+    // One extra for the first line's rates
+    if (count + 1 > taken)
+        count = taken - 1;
+    if (count + 1 > STATS_SAMPLES)
+        count = STATS_SAMPLES - 1;
+    first = taken - count;
+
+    puts("   time s  free pages  timers  irqs/s  callbacks/s\n");
+    for (i = first; i < taken; i++) {
+        stats_sample_t * now = &samples[i % STATS_SAMPLES], * prev = &samples[(i - 1) % STATS_SAMPLES];
+        uint32_t ticks = now->tick - prev->tick;
+
+        stats_print_col(now->tick * TIMER_TICK_MS / 1000, 9);
+        stats_print_col(now->free_pages, 12);
+        stats_print_col(now->pending_timers, 8);
+        stats_print_col(stats_rate(now->interrupts, prev->interrupts, ticks), 8);
+        stats_print_col(stats_rate(now->timer_callbacks, prev->timer_callbacks, ticks), 13);
+        putc('\n');
+    }
+}
@@ -0,0 +1,115 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/mem.h>
+#include <kernel/syscall.h>
+#include <kernel/task.h>
+#include <kernel/timer.h>
+#include <kernel/uart.h>
+#include <common/stdio.h>
+
+#define SYSCALL_ERROR ((uintptr_t)-1)
+
+// The fast ones run with interrupts masked on the task's kernel stack, see vectors.S
+
+static uintptr_t sys_getpid_handler(uintptr_t arg0, uintptr_t arg1, uintptr_t arg2) {
+    (void) arg0;
+    (void) arg1;
+    (void) arg2;
+    return task_current()->id;
+}
+
+static uintptr_t sys_time_handler(uintptr_t arg0, uintptr_t arg1, uintptr_t arg2) {
+    (void) arg0;
+    (void) arg1;
+    (void) arg2;
+    return timer_get_tick_count() * TIMER_TICK_MS;
+}
+
+// The heap may grow up to the bottom of the user stack
+static uintptr_t sys_sbrk_handler(uintptr_t increment, uintptr_t arg1, uintptr_t arg2) {
+    task_t * task = task_current();
+    uintptr_t old = task->brk, new = old + (intptr_t)increment;
+    uintptr_t limit = (uintptr_t)task->user_base + (TASK_USER_PAGES - TASK_STACK_PAGES) * PAGE_SIZE;
+
+    (void) arg1;
+    (void) arg2;
+    if (new < (uintptr_t)task->user_base || new > limit)
+        return SYSCALL_ERROR;
+    task->brk = new;
+    return old;
+}
+
+const syscall_f syscall_fast_table[SYSCALL_FAST_COUNT] = {
+    [SYS_GETPID] = sys_getpid_handler,
+    [SYS_TIME] = sys_time_handler,
+    [SYS_SBRK] = sys_sbrk_handler,
+};
+
+static uintptr_t sys_write_handler(task_t * task, uintptr_t fd, uintptr_t buf, uintptr_t len) {
+    if (fd != 1 && fd != 2)
+        return SYSCALL_ERROR;
+    if (!task_access_ok(task, buf, len, 0))
+        return SYSCALL_ERROR;
+    write((const char *)buf, len);
+    return len;
+}
+
+// Waits for the first character by letting the other tasks run, then takes whatever else has
+// already arrived
+static uintptr_t sys_read_handler(task_t * task, uintptr_t fd, uintptr_t buf, uintptr_t len) {
+    char * dest = (char *)buf;
+    uintptr_t got = 0;
+    int c;
+
+    if (fd != 0)
+        return SYSCALL_ERROR;
+    if (!task_access_ok(task, buf, len, 1))
+        return SYSCALL_ERROR;
+    while (got < len) {
+        c = uart_getc_timeout(0);
+        if (c < 0) {
+            if (got > 0)
+                break;
+            // Nothing else to run, so sleep until the next interrupt instead of spinning
+            if (task_count() == 1)
+                wfi();
+            task_yield();
+            continue;
+        }
+        dest[got++] = c;
+        if (c == '\r' || c == '\n')
+            break;
+    }
+    return got;
+}
+
+void syscall_dispatch(trap_frame_t * frame) {
+    task_t * task = task_current();
+#ifdef __aarch64__
+    uint64_t * args = frame->x;
+    uintptr_t number = frame->x[8], res;
+#else
+    uint32_t * args = frame->r;
+    uintptr_t number = frame->r[7], res;
+#endif
+
+    switch (number) {
+    case SYS_WRITE:
+        res = sys_write_handler(task, args[0], args[1], args[2]);
+        break;
+    case SYS_READ:
+        res = sys_read_handler(task, args[0], args[1], args[2]);
+        break;
+    case SYS_YIELD:
+        task_yield();
+        res = 0;
+        break;
+    case SYS_EXIT:
+        task_exit(args[0]);
+    default:
+        res = SYSCALL_ERROR;
+        break;
+    }
+    args[0] = res;
+}
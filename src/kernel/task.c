@@ -0,0 +1,156 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/mem.h>
+#include <kernel/printk.h>
+#include <kernel/task.h>
+#include <kernel/vdso.h>
+#include <kernel/vm.h>
+#include <common/stdio.h>
+#include <common/stdlib.h>
+#include <user/ulib.h>
+
+IMPLEMENT_LIST(task);
+
+extern uint8_t __start;
+extern uint8_t __end;
+
+static task_list_t ready_tasks;
+static task_t * current;
+static cpu_context_t scheduler_context;     // The shell, while a task runs
+static uint32_t next_id = 1;
+static uint32_t live_tasks;
+static uint32_t switches;
+
+static void task_free(task_t * task) {
+    uint32_t i;
+
+    for (i = 0; i < TASK_USER_PAGES; i++)
+        free_page(task->user_base + i * PAGE_SIZE);
+    free_page(task->kstack);
+    kfree(task);
+}
+
+int task_create(const char * name, task_entry_t entry, uintptr_t arg) {
+    task_t * task;
+    trap_frame_t * frame;
+    uint32_t i;
+
+    if ((task = kmalloc(sizeof(task_t))) == NULL)
+        return -1;
+    bzero(task, sizeof(task_t));
+    task->kstack = alloc_page();
+    // Aligned to its size the user area is one large page, so a switch changes one TLB entry
+    if ((task->user_base = alloc_pages_aligned(TASK_USER_PAGES, TASK_USER_PAGES)) == NULL)
+        task->user_base = alloc_pages(TASK_USER_PAGES);
+    // Split the mapping under the user area now, so opening it up on a switch can't fail
+    if (task->kstack == NULL || task->user_base == NULL ||
+            vm_user_access(task->user_base, TASK_USER_PAGES * PAGE_SIZE, MMU_USER_NONE) != 0) {
+        if (task->kstack != NULL)
+            free_page(task->kstack);
+        if (task->user_base != NULL)
+            for (i = 0; i < TASK_USER_PAGES; i++)
+                free_page(task->user_base + i * PAGE_SIZE);
+        kfree(task);
+        return -1;
+    }
+
+    task->id = next_id++;
+    for (i = 0; i < TASK_NAME_LEN - 1 && name[i] != '\0'; i++)
+        task->name[i] = name[i];
+    task->brk = (uintptr_t)task->user_base;
+
+    // The first switch to the task "returns" into cpu_enter_user, which drops to user mode
+    // through a trap frame at the top of the kernel stack.  Returning from entry lands in
+    // sys_exit with the return value as the exit code
+    frame = (trap_frame_t *)(task->kstack + PAGE_SIZE) - 1;
+#ifdef __aarch64__
+    frame->x[0] = arg;
+    frame->x[1] = (uintptr_t)vdso_page();
+    frame->x[30] = (uintptr_t)sys_exit;
+    frame->pstate = CPU_USER_PSTATE;
+#else
+    frame->r[0] = arg;
+    frame->r[1] = (uintptr_t)vdso_page();
+    frame->lr = (uintptr_t)sys_exit;
+    frame->cpsr = CPU_USER_PSTATE;
+#endif
+    frame->sp = (uintptr_t)task->user_base + TASK_USER_PAGES * PAGE_SIZE;
+    frame->pc = (uintptr_t)entry;
+    task->context.sp = (uintptr_t)frame;
+    task->context.lr = (uintptr_t)cpu_enter_user;
+
+    task->state = TASK_READY;
+    append_task_list(&ready_tasks, task);
+    live_tasks++;
+    return task->id;
+}
+
+void task_schedule(void) {
+    task_t * task;
+
+    while ((task = pop_task_list(&ready_tasks)) != NULL) {
+        current = task;
+        task->state = TASK_RUNNING;
+        switches++;
+        // Only the running task can get at its memory from user mode
+        vm_user_access(task->user_base, TASK_USER_PAGES * PAGE_SIZE, MMU_USER_WRITE);
+        cpu_switch(&scheduler_context, &task->context);
+        vm_user_access(task->user_base, TASK_USER_PAGES * PAGE_SIZE, MMU_USER_NONE);
+        current = NULL;
+        printk_drain();
+
+        // Back on our own stack, so a dead task's kernel stack can go now.  Only failures
+        // are worth a line
+        if (task->state == TASK_DEAD) {
+            if (task->exit_code != 0) {
+                puts("[");
+                puts(itoa(task->id));
+                puts("] ");
+                puts(task->name);
+                puts(" exited with code ");
+                puts(itoa(task->exit_code));
+                putc('\n');
+            }
+            live_tasks--;
+            task_free(task);
+        } else {
+            task->state = TASK_READY;
+            append_task_list(&ready_tasks, task);
+        }
+    }
+}
+
+void task_yield(void) {
+    cpu_switch(&current->context, &scheduler_context);
+}
+
+void task_exit(int code) {
+    current->state = TASK_DEAD;
+    current->exit_code = code;
+    cpu_switch(&current->context, &scheduler_context);
+    // Nothing switches back to a dead task
+    while (1);
+}
+
+task_t * task_current(void) {
+    return current;
+}
+
+int task_access_ok(const task_t * task, uintptr_t addr, uintptr_t len, int write) {
+    uintptr_t user = (uintptr_t)task->user_base;
+
+    if (addr + len < addr)
+        return 0;
+    if (addr >= user && addr + len <= user + TASK_USER_PAGES * PAGE_SIZE)
+        return 1;
+    return !write && addr >= (uintptr_t)&__start && addr + len <= (uintptr_t)&__end;
+}
+
+uint32_t task_count(void) {
+    return live_tasks;
+}
+
+uint32_t task_switch_count(void) {
+    return switches;
+}
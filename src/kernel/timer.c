@@ -0,0 +1,246 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/interrupts.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <kernel/uart.h>
+#include <common/stdlib.h>
+
+uint32_t timer_get_ticks(void)
+{
+    return mmio_read(SYSTEM_TIMER_CLO);
+}
+
+uint64_t timer_get_ticks64(void)
+{
+    uint32_t hi, lo;
+
+    // Re-read the high word in case the low word rolled over between the two reads
+    do {
+        hi = mmio_read(SYSTEM_TIMER_CHI);
+        lo = mmio_read(SYSTEM_TIMER_CLO);
+    } while (hi != mmio_read(SYSTEM_TIMER_CHI));
+
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void udelay(uint32_t usecs)
+{
+    uint32_t start = timer_get_ticks();
+
+    while (timer_get_ticks() - start < usecs);
+}
+
+IMPLEMENT_LIST(timer);
+
+static timer_list_t timer_root[TIMER_ROOT_SIZE];
+static timer_list_t timer_levels[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+// Timers due this tick, taken off the wheel before any callback runs.  A callback re-adding
+// a timer 256 ticks out would otherwise land back in the slot being emptied
+static timer_list_t timer_expiring;
+static spinlock_t timer_lock;
+
+// The next tick to process, and the counter value it is due at
+static volatile uint32_t timer_jiffies;
+static uint32_t timer_compare;
+static timer_stats_t timer_stats;
+
+// Put a timer in the slot for its expiry.  Called with timer_lock held
+static void timer_enqueue(timer_t * timer) {
+    uint32_t expires = timer->expires, delta = expires - timer_jiffies;
+    timer_list_t * slot;
+
+    if ((int32_t)delta < 0) {
+        // Already due, run it on the next tick
+        slot = &timer_root[timer_jiffies & (TIMER_ROOT_SIZE - 1)];
+    } else if (delta < TIMER_ROOT_SIZE) {
+        slot = &timer_root[expires & (TIMER_ROOT_SIZE - 1)];
+    } else if (delta < 1 << (TIMER_ROOT_BITS + TIMER_LEVEL_BITS)) {
+        slot = &timer_levels[0][(expires >> TIMER_ROOT_BITS) & (TIMER_LEVEL_SIZE - 1)];
+    } else if (delta < 1 << (TIMER_ROOT_BITS + 2 * TIMER_LEVEL_BITS)) {
+        slot = &timer_levels[1][(expires >> (TIMER_ROOT_BITS + TIMER_LEVEL_BITS)) & (TIMER_LEVEL_SIZE - 1)];
+    } else {
+        if (delta > TIMER_MAX_TICKS) {
+            expires = timer_jiffies + TIMER_MAX_TICKS;
+            timer->expires = expires;
+        }
+        slot = &timer_levels[2][(expires >> (TIMER_ROOT_BITS + 2 * TIMER_LEVEL_BITS)) & (TIMER_LEVEL_SIZE - 1)];
+    }
+    append_timer_list(slot, timer);
+    timer->slot = slot;
+}
+
+// Move every timer in a slot of one level down to where it belongs now.  Returns the slot
+// index, which is 0 when the level above needs cascading too
+static uint32_t timer_cascade(uint32_t level, uint32_t index) {
+    timer_list_t * slot = &timer_levels[level][index];
+    timer_t * timer;
+
+    while ((timer = pop_timer_list(slot)) != NULL) {
+        timer_enqueue(timer);
+        timer_stats.cascaded++;
+    }
+    return index;
+}
+
+#define TIMER_LEVEL_INDEX(level) \
+    ((timer_jiffies >> (TIMER_ROOT_BITS + (level) * TIMER_LEVEL_BITS)) & (TIMER_LEVEL_SIZE - 1))
+
+// Process one tick: cascade if the root wheel wrapped, then run what is due
+static void timer_run_tick(void) {
+    uint32_t index = timer_jiffies & (TIMER_ROOT_SIZE - 1), level;
+    timer_callback_t callback;
+    timer_t * timer;
+    void * data;
+
+    spin_lock(&timer_lock);
+    if (index == 0) {
+        for (level = 0; level < TIMER_LEVELS && timer_cascade(level, TIMER_LEVEL_INDEX(level)) == 0; level++);
+    }
+    timer_jiffies++;
+
+    timer_expiring = timer_root[index];
+    INITIALIZE_LIST(timer_root[index]);
+    for (timer = timer_expiring.head; timer != NULL; timer = next_timer_list(timer))
+        timer->slot = &timer_expiring;
+
+    while ((timer = pop_timer_list(&timer_expiring)) != NULL) {
+        timer->slot = NULL;
+        timer_stats.pending--;
+        callback = timer->callback;
+        data = timer->data;
+        // Periodic timers go back on the wheel first, so the callback can cancel them
+        if (timer->period) {
+            timer->expires += timer->period;
+            timer_enqueue(timer);
+            timer_stats.pending++;
+        }
+        timer_stats.expired++;
+
+        spin_unlock(&timer_lock);
+        callback(data);
+        spin_lock(&timer_lock);
+    }
+    spin_unlock(&timer_lock);
+}
+
+static void timer_irq_clearer(void) {
+    mmio_write(SYSTEM_TIMER_CS, SYSTEM_TIMER_MATCH(1));
+}
+
+static void timer_irq_handler(void) {
+    uint32_t start = cpu_cycles(), due = 0, cycles;
+
+    // Count every tick that has come due, in case interrupts were masked through some of them.
+    // The compare only matches on equality, so if the counter passes the new value before it
+    // is written there will be no interrupt: check again after writing
+    do {
+        while ((int32_t)(timer_get_ticks() - timer_compare) >= 0) {
+            timer_compare += TIMER_TICK_US;
+            due++;
+        }
+        mmio_write(SYSTEM_TIMER_C1, timer_compare);
+    } while ((int32_t)(timer_get_ticks() - timer_compare) >= 0);
+
+    while (due--) {
+        timer_run_tick();
+        timer_stats.ticks++;
+    }
+
+    cycles = cpu_cycles() - start;
+    timer_stats.interrupts++;
+    timer_stats.total_irq_cycles += cycles;
+    if (cycles > timer_stats.max_irq_cycles)
+        timer_stats.max_irq_cycles = cycles;
+}
+
+void timer_init(void) {
+    uint32_t i, j;
+
+    spin_lock_init(&timer_lock, "timer");
+    // INITIALIZE_LIST is two statements, hence the braces
+    for (i = 0; i < TIMER_ROOT_SIZE; i++) {
+        INITIALIZE_LIST(timer_root[i]);
+    }
+    for (i = 0; i < TIMER_LEVELS; i++) {
+        for (j = 0; j < TIMER_LEVEL_SIZE; j++) {
+            INITIALIZE_LIST(timer_levels[i][j]);
+        }
+    }
+
+    timer_compare = timer_get_ticks() + TIMER_TICK_US;
+    mmio_write(SYSTEM_TIMER_C1, timer_compare);
+    mmio_write(SYSTEM_TIMER_CS, SYSTEM_TIMER_MATCH(1));
+    register_irq_handler(IRQ_SYSTEM_TIMER_1, timer_irq_handler, timer_irq_clearer);
+}
+
+void timer_setup(timer_t * timer, timer_callback_t callback, void * data) {
+    timer->expires = 0;
+    timer->period = 0;
+    timer->callback = callback;
+    timer->data = data;
+    timer->slot = NULL;
+    timer->nexttimer = timer->prevtimer = NULL;
+}
+
+static void timer_arm(timer_t * timer, uint32_t ticks, uint32_t period) {
+    uintptr_t flags = spin_lock_irqsave(&timer_lock);
+
+    if (timer->slot != NULL)
+        remove_timer_list(timer->slot, timer);
+    else
+        timer_stats.pending++;
+    timer->expires = timer_jiffies + ticks;
+    timer->period = period;
+    timer_enqueue(timer);
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+void timer_add(timer_t * timer, uint32_t msecs) {
+    timer_arm(timer, TIMER_MS_TO_TICKS(msecs), 0);
+}
+
+void timer_add_periodic(timer_t * timer, uint32_t msecs) {
+    uint32_t ticks = TIMER_MS_TO_TICKS(msecs);
+
+    timer_arm(timer, ticks, ticks ? ticks : 1);
+}
+
+int timer_cancel(timer_t * timer) {
+    uintptr_t flags = spin_lock_irqsave(&timer_lock);
+    int pending = timer->slot != NULL;
+
+    if (pending) {
+        remove_timer_list(timer->slot, timer);
+        timer->slot = NULL;
+        timer_stats.pending--;
+    }
+    timer->period = 0;
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return pending;
+}
+
+int timer_pending(const timer_t * timer) {
+    return timer->slot != NULL;
+}
+
+uint32_t timer_get_tick_count(void) {
+    return timer_jiffies;
+}
+
+void timer_get_stats(timer_stats_t * stats) {
+    uintptr_t flags = spin_lock_irqsave(&timer_lock);
+
+    *stats = timer_stats;
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+void timer_reset_stats(void) {
+    uintptr_t flags = spin_lock_irqsave(&timer_lock);
+    uint32_t pending = timer_stats.pending;
+
+    bzero(&timer_stats, sizeof(timer_stats));
+    timer_stats.pending = pending;
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
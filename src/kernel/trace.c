@@ -0,0 +1,81 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/cpu.h>
+#include <kernel/mailbox.h>
+#include <kernel/trace.h>
+#include <kernel/uart.h>
+#include <common/stdlib.h>
+
+/**
+ * Dump format, all little endian:
+ *   header:  "RTRC", u16 version, u16 record size, u32 cpu count, u32 cycle counter Hz
+ *   per cpu: u32 cpu, u32 record count, that many records, oldest first
+ *   trailer: "RTRE"
+ */
+#define TRACE_DUMP_VERSION 1
+
+trace_ring_t trace_rings[NUM_CPUS];
+volatile uint32_t trace_enabled;
+
+void trace_init(void)
+{
+    cpu_cycles_init();
+    trace_clear();
+    trace_enabled = 1;
+}
+
+void trace_clear(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_CPUS; i++)
+        trace_rings[i].head = 0;
+}
+
+static void trace_write_u32(uint32_t value)
+{
+    char bytes[4];
+
+    bytes[0] = value;
+    bytes[1] = value >> 8;
+    bytes[2] = value >> 16;
+    bytes[3] = value >> 24;
+    uart_write(bytes, 4);
+}
+
+void trace_dump(void)
+{
+    uint32_t was_enabled = trace_enabled, cpu, head, count, first, last;
+    trace_ring_t * ring;
+
+    trace_enabled = 0;
+
+    uart_write("RTRC", 4);
+    trace_write_u32(TRACE_DUMP_VERSION | (sizeof(trace_record_t) << 16));
+    trace_write_u32(NUM_CPUS);
+    // The cycle counter runs at the ARM clock
+    trace_write_u32(mailbox_get_clock_rate(MAILBOX_CLOCK_ARM));
+
+    for (cpu = 0; cpu < NUM_CPUS; cpu++) {
+        ring = &trace_rings[cpu];
+        head = ring->head;
+        count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        trace_write_u32(cpu);
+        trace_write_u32(count);
+
+        // Oldest first.  When the ring has wrapped that is the slot head points at,
+        // so the records go out in up to two pieces
+        first = (head - count) & (TRACE_RING_SIZE - 1);
+        last = first + count;
+        if (last > TRACE_RING_SIZE) {
+            uart_write((const char *)&ring->records[first], (TRACE_RING_SIZE - first) * sizeof(trace_record_t));
+            uart_write((const char *)&ring->records[0], (last - TRACE_RING_SIZE) * sizeof(trace_record_t));
+        } else {
+            uart_write((const char *)&ring->records[first], count * sizeof(trace_record_t));
+        }
+    }
+
+    uart_write("RTRE", 4);
+    uart_flush();
+    trace_enabled = was_enabled;
+}
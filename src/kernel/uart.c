@@ -1,30 +1,28 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <kernel/uart.h>
+#include <kernel/mailbox.h>
+#include <kernel/spinlock.h>
+#include <kernel/timer.h>
+#include <kernel/trace.h>
 #include <common/stdlib.h>
+#include <common/string.h>
 
-// Memory-Mapped I/O output
-void mmio_write(uint32_t reg, uint32_t data)
-{
-    *(volatile uint32_t*)reg = data;
-}
-
-// Memory-Mapped I/O input
-uint32_t mmio_read(uint32_t reg)
-{
-    return *(volatile uint32_t*)reg;
-}
-
-// Loop <delay> times in a way that the compiler won't optimize away
-void delay(int32_t count)
-{
-    asm volatile("__delay_%=: subs %[count], %[count], #1; bne __delay_%=\n"
-            : "=r"(count): [count]"0"(count) : "cc");
-}
+static uint32_t uart_clock = UART_DEFAULT_CLOCK;
+static uint32_t uart_baud;
+// Free FIFO slots guaranteed while the raw transmit interrupt is asserted
+static uint32_t uart_tx_burst = UART_FIFO_DEPTH;
+// Keep writers from interleaving inside each other's output, and the line settings stable under them
+static spinlock_t uart_tx_lock;
+static spinlock_t uart_rx_lock;
 
 void uart_init()
 {
     uart_control_t control;
+    uint32_t clock;
+
+    spin_lock_init(&uart_tx_lock, "uart tx");
+    spin_lock_init(&uart_rx_lock, "uart rx");
     // Disable UART0.
     bzero(&control, 4);
     mmio_write(UART0_CR, control.as_int);
@@ -44,18 +42,19 @@ void uart_init()
     // Clear pending interrupts.
     mmio_write(UART0_ICR, 0x7FF);
 
-    // Set integer & fractional part of baud rate.
-    // Divider = UART_CLOCK/(16 * Baud)
-    // Fraction part register = (Fractional part * 64) + 0.5
-    // UART_CLOCK = 3000000; Baud = 115200.
+    // Find out what the UART is really clocked at.  Older firmware runs it at 3 MHz, newer
+    // firmware at 48 MHz.  qemu's firmware model reports 3 MHz and won't change it, so there
+    // nothing above 187500 baud can be set
+    clock = mailbox_get_clock_rate(MAILBOX_CLOCK_UART);
+    if (clock != 0)
+        uart_clock = clock;
 
-    // Divider = 3000000 / (16 * 115200) = 1.627 = ~1.
-    mmio_write(UART0_IBRD, 1);
-    // Fractional part register = (.627 * 64) + 0.5 = 40.6 = ~40.
-    mmio_write(UART0_FBRD, 40);
+    // Set integer & fractional part of baud rate, then enable FIFO & 8 bit data
+    // transmission (1 stop bit, no parity).
+    uart_set_baud(UART_DEFAULT_BAUD);
 
-    // Enable FIFO & 8 bit data transmissio (1 stop bit, no parity).
-    mmio_write(UART0_LCRH, (1 << 4) | (1 << 5) | (1 << 6));
+    // Keep at least 14 bytes of room whenever the transmit trigger fires
+    uart_set_fifo_levels(UART_FIFO_1_8, UART_FIFO_1_2);
 
     // Mask all interrupts.
     mmio_write(UART0_IMSC, (1 << 1) | (1 << 4) | (1 << 5) | (1 << 6) |
@@ -68,6 +67,97 @@ void uart_init()
     mmio_write(UART0_CR, control.as_int);
 }
 
+// Divider = UART_CLOCK/(16 * Baud), as a fixed point number with 6 fractional bits:
+// Divider * 64 = UART_CLOCK * 4 / Baud, rounded to the nearest integer.  0 if the rate is out
+// of reach.  The PL011 samples each bit 16 times, so it can't go faster than UART_CLOCK / 16
+static uint32_t uart_divisor(uint32_t clock, uint32_t baud)
+{
+    uint32_t divisor;
+
+    if (baud == 0 || (uint64_t)baud * 16 > clock)
+        return 0;
+    divisor = ((uint64_t)clock * 4 + baud / 2) / baud;
+    if ((divisor >> 6) == 0 || (divisor >> 6) > 0xFFFF)
+        return 0;
+    return divisor;
+}
+
+static void uart_program(uint32_t divisor, uint32_t baud)
+{
+    uint32_t control;
+
+    // Let the bytes already queued go out at the old rate, then disable the UART while
+    // the divisors change
+    spin_lock(&uart_tx_lock);
+    uart_flush();
+    control = mmio_read(UART0_CR);
+    mmio_write(UART0_CR, 0);
+
+    mmio_write(UART0_IBRD, divisor >> 6);
+    mmio_write(UART0_FBRD, divisor & 0x3F);
+    // The divisors only take effect on a write to LCRH.
+    // Enable FIFO & 8 bit data transmission (1 stop bit, no parity).
+    mmio_write(UART0_LCRH, (1 << 4) | (1 << 5) | (1 << 6));
+
+    mmio_write(UART0_CR, control);
+    uart_baud = baud;
+    spin_unlock(&uart_tx_lock);
+}
+
+// Ask the firmware for a faster clock.  Firmware that ignores the request can still echo the
+// rate back in the reply, so only believe the clock it reports afterwards.  If it did change,
+// the current rate is set again from the new clock
+static void uart_raise_clock(void)
+{
+    uint32_t clock, divisor;
+
+    uart_flush();
+    mailbox_set_clock_rate(MAILBOX_CLOCK_UART, UART_FAST_CLOCK);
+    clock = mailbox_get_clock_rate(MAILBOX_CLOCK_UART);
+    if (clock == 0 || clock == uart_clock)
+        return;
+    uart_clock = clock;
+    if (uart_baud != 0 && (divisor = uart_divisor(clock, uart_baud)) != 0)
+        uart_program(divisor, uart_baud);
+}
+
+int uart_baud_supported(uint32_t baud)
+{
+    if (uart_divisor(uart_clock, baud) == 0)
+        uart_raise_clock();
+    return uart_divisor(uart_clock, baud) != 0;
+}
+
+int uart_set_baud(uint32_t baud)
+{
+    if (!uart_baud_supported(baud))
+        return -1;
+    uart_program(uart_divisor(uart_clock, baud), baud);
+    return 0;
+}
+
+uint32_t uart_get_baud(void)
+{
+    return uart_baud;
+}
+
+uint32_t uart_get_clock(void)
+{
+    return uart_clock;
+}
+
+int uart_set_fifo_levels(uart_fifo_level_t tx_level, uart_fifo_level_t rx_level)
+{
+    // FIFO fill level in bytes for each trigger level
+    static const uint8_t level_bytes[] = { 2, 4, 8, 12, 14 };
+
+    if ((uint32_t)tx_level > UART_FIFO_7_8 || (uint32_t)rx_level > UART_FIFO_7_8)
+        return -1;
+    mmio_write(UART0_IFLS, tx_level | (rx_level << 3));
+    uart_tx_burst = UART_FIFO_DEPTH - level_bytes[tx_level];
+    return 0;
+}
+
 
 uart_flags_t read_flags(void) {
     uart_flags_t flags;
@@ -80,20 +170,119 @@ void uart_putc(unsigned char c)
     uart_flags_t flags;
     // Wait for UART to become ready to transmit.
 
+    spin_lock(&uart_tx_lock);
     do {
         flags = read_flags();
     }
     while ( flags.transmit_queue_full );
     mmio_write(UART0_DR, c);
+    spin_unlock(&uart_tx_lock);
+    trace(TRACE_UART_PUTC, c, 0);
+}
+
+void uart_putc_raw(unsigned char c)
+{
+    while (read_flags().transmit_queue_full);
+    mmio_write(UART0_DR, c);
 }
 
 unsigned char uart_getc()
 {
     // Wait for UART to have received something.
     uart_flags_t flags;
+    unsigned char c;
+    spin_lock(&uart_rx_lock);
     do {
         flags = read_flags();
     }
     while ( flags.recieve_queue_empty );
-    return mmio_read(UART0_DR);
+    c = mmio_read(UART0_DR);
+    spin_unlock(&uart_rx_lock);
+    trace(TRACE_UART_GETC, c, 0);
+    return c;
+}
+
+int uart_getc_timeout(uint32_t usecs)
+{
+    uart_flags_t flags;
+    uint32_t start = timer_get_ticks();
+    unsigned char c;
+
+    // Poll without the lock, so idle loops don't count as taking it.  Another reader may get
+    // the character between the check and the lock, then keep waiting
+    while (1) {
+        do {
+            flags = read_flags();
+            if (flags.recieve_queue_empty && timer_get_ticks() - start >= usecs)
+                return -1;
+        }
+        while ( flags.recieve_queue_empty );
+        spin_lock(&uart_rx_lock);
+        if (!read_flags().recieve_queue_empty)
+            break;
+        spin_unlock(&uart_rx_lock);
+    }
+    c = mmio_read(UART0_DR);
+    spin_unlock(&uart_rx_lock);
+    trace(TRACE_UART_GETC, c, 0);
+    return c;
+}
+
+void uart_write(const char * buf, size_t len)
+{
+    uart_flags_t flags;
+    size_t burst;
+
+    trace(TRACE_UART_WRITE, len, 0);
+    spin_lock(&uart_tx_lock);
+    while (len > 0) {
+        // One flag read tells us how much room there is.  An empty FIFO takes a full burst,
+        // a FIFO at or below the transmit trigger level takes everything above the level,
+        // otherwise fall back to one byte at a time
+        flags = read_flags();
+        if (flags.transmit_queue_empty)
+            burst = UART_FIFO_DEPTH;
+        else if (mmio_read(UART0_RIS) & UART_INT_TX)
+            burst = uart_tx_burst;
+        else if (!flags.transmit_queue_full)
+            burst = 1;
+        else
+            continue;
+
+        if (burst > len)
+            burst = len;
+        len -= burst;
+        while (burst--)
+            mmio_write(UART0_DR, (unsigned char)*buf++);
+    }
+    spin_unlock(&uart_tx_lock);
+}
+
+size_t uart_try_write(const char * buf, size_t len)
+{
+    size_t sent = 0;
+
+    // Somebody else is writing, they'll be a while
+    if (!spin_trylock(&uart_tx_lock))
+        return 0;
+    while (sent < len && !read_flags().transmit_queue_full)
+        mmio_write(UART0_DR, (unsigned char)buf[sent++]);
+    spin_unlock(&uart_tx_lock);
+    if (sent)
+        trace(TRACE_UART_WRITE, sent, 0);
+    return sent;
+}
+
+void uart_puts(const char * str)
+{
+    uart_write(str, strlen(str));
+}
+
+void uart_flush(void)
+{
+    uart_flags_t flags;
+
+    do {
+        flags = read_flags();
+    } while (flags.busy || !flags.transmit_queue_empty);
 }
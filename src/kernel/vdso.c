@@ -0,0 +1,50 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/atomic.h>
+#include <kernel/interrupts.h>
+#include <kernel/mem.h>
+#include <kernel/task.h>
+#include <kernel/timer.h>
+#include <kernel/vdso.h>
+#include <kernel/vm.h>
+
+static vdso_page_t * vdso;
+static timer_t vdso_timer;
+
+// Runs in interrupt context off the periodic timer, so it is the only writer
+static void vdso_update(void * data) {
+    (void) data;
+
+    vdso->seq++;
+    dmb();
+    vdso->ticks = timer_get_tick_count();
+    vdso->uptime_us = timer_get_ticks64();
+    vdso->free_pages = mem_free_pages();
+    vdso->interrupts = interrupts_count();
+    vdso->context_switches = task_switch_count();
+    vdso->tasks = task_count();
+    vdso->updates++;
+    dmb();
+    vdso->seq++;
+}
+
+void vdso_init(void) {
+    // alloc_page zeroes it, so seq starts out even
+    vdso = alloc_page();
+    if (vdso == NULL)
+        return;
+    // Tasks get it in their second argument and read it from user mode
+    if (vm_user_access(vdso, PAGE_SIZE, MMU_USER_READ) != 0) {
+        free_page(vdso);
+        vdso = NULL;
+        return;
+    }
+    vdso->tick_ms = TIMER_TICK_MS;
+    vdso_update(NULL);
+    timer_setup(&vdso_timer, vdso_update, NULL);
+    timer_add_periodic(&vdso_timer, VDSO_PERIOD_MS);
+}
+
+const vdso_page_t * vdso_page(void) {
+    return vdso;
+}
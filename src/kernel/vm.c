@@ -0,0 +1,381 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/mem.h>
+#include <kernel/mmu.h>
+#include <kernel/printk.h>
+#include <kernel/spinlock.h>
+#include <kernel/vm.h>
+
+#define VM_GRANULES ((VM_END - VM_START) / VM_GRANULE)
+#define ALIGN_UP(x, align) (((x) + (align) - 1) & ~((uintptr_t)(align) - 1))
+
+IMPLEMENT_LIST(vm_area);
+
+static int vm_on;
+// Areas and the address bitmap, and the page tables under them.  IRQ safe, faults come in with
+// interrupts masked
+static spinlock_t vm_lock;
+static vm_area_list_t vm_areas;
+static uint32_t vm_bitmap[VM_GRANULES / 32];        // Granules in use
+static uint32_t asid_bitmap[MMU_NUM_ASIDS / 32];
+static vm_stats_t vm_stats;
+
+extern uint8_t __start;
+extern uint8_t __end;
+
+int vm_init(void) {
+    uintptr_t start = (uintptr_t)&__start & ~(PAGE_SIZE - 1);
+    uintptr_t end = ((uintptr_t)&__end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    spin_lock_init(&vm_lock, "vm");
+    INITIALIZE_LIST(vm_areas);
+    asid_bitmap[0] = 1;             // The kernel's
+    if (mmu_init(mem_num_pages() * PAGE_SIZE) != 0)
+        return -1;
+    vm_on = 1;
+    // User programs are linked into the kernel, so user mode reads its code and constants there
+    if (vm_user_access((void *)start, end - start, MMU_USER_READ) != 0)
+        printk(LOG_ERR, "vm_init: out of page table memory, user programs can't run");
+    return 0;
+}
+
+int vm_enabled(void) {
+    return vm_on;
+}
+
+static int granule_used(uint32_t i) {
+    return vm_bitmap[i / 32] & (1 << (i % 32));
+}
+
+static void granules_set(uint32_t first, uint32_t count, int used) {
+    uint32_t i;
+
+    for (i = first; i < first + count; i++) {
+        if (used)
+            vm_bitmap[i / 32] |= 1 << (i % 32);
+        else
+            vm_bitmap[i / 32] &= ~(1 << (i % 32));
+    }
+}
+
+// The biggest mapping the flags allow at va -> pa with length bytes left
+static uint32_t vm_mapping_size(uintptr_t va, uintptr_t pa, uint32_t length, uint32_t flags) {
+    if (!(flags & (VM_NO_SECTIONS | VM_SMALL_PAGES)) && (va | pa) % SECTION_SIZE == 0 && length >= SECTION_SIZE)
+        return SECTION_SIZE;
+    if (!(flags & VM_SMALL_PAGES) && (va | pa) % LARGE_PAGE_SIZE == 0 && length >= LARGE_PAGE_SIZE)
+        return LARGE_PAGE_SIZE;
+    return PAGE_SIZE;
+}
+
+static mmu_memory_t vm_memory_type(uint32_t flags) {
+    if (flags & VM_DEVICE)
+        return MMU_DEVICE;
+    if (flags & VM_UNCACHED)
+        return MMU_UNCACHED;
+    return MMU_NORMAL;
+}
+
+// Find length bytes of addresses starting skew bytes past a multiple of align, first fit.
+// Called with vm_lock held
+static vm_area_t * vm_area_new(uint32_t length, uint32_t align, uint32_t skew, uint32_t flags) {
+    uint32_t step, first, count, base, i;
+    vm_area_t * area;
+
+    if (align < VM_GRANULE)
+        align = VM_GRANULE;
+    step = align / VM_GRANULE;
+    first = skew / VM_GRANULE;
+    count = (skew + length + VM_GRANULE - 1) / VM_GRANULE - first;
+
+    for (base = 0; base + first + count <= VM_GRANULES; base += step) {
+        for (i = 0; i < count && !granule_used(base + first + i); i++);
+        if (i < count)
+            continue;
+        if ((area = kmalloc(sizeof(vm_area_t))) == NULL)
+            return NULL;
+        area->addr = VM_START + base * VM_GRANULE + skew;
+        area->length = length;
+        area->phys = 0;
+        area->flags = flags;
+        area->first_granule = base + first;
+        area->granules = count;
+        granules_set(area->first_granule, count, 1);
+        append_vm_area_list(&vm_areas, area);
+        vm_stats.areas++;
+        return area;
+    }
+    return NULL;
+}
+
+static void vm_area_delete(vm_area_t * area) {
+    granules_set(area->first_granule, area->granules, 0);
+    remove_vm_area_list(&vm_areas, area);
+    vm_stats.areas--;
+    kfree(area);
+}
+
+static vm_area_t * vm_area_find(uintptr_t addr) {
+    vm_area_t * area;
+
+    for (area = peek_vm_area_list(&vm_areas); area != NULL; area = next_vm_area_list(area))
+        if (addr >= area->addr && addr - area->addr < area->length)
+            return area;
+    return NULL;
+}
+
+static void vm_count_mapping(uint32_t size, int delta) {
+    if (size == SECTION_SIZE)
+        vm_stats.sections += delta;
+    else if (size == LARGE_PAGE_SIZE)
+        vm_stats.large_pages += delta;
+    else
+        vm_stats.small_pages += delta;
+}
+
+// Point the RAM pages under a mapping at va, or back at themselves when va is 0
+static void vm_set_vaddr(uintptr_t pa, uint32_t size, uintptr_t va) {
+    page_t * page;
+    uint32_t i;
+
+    for (i = 0; i < size; i += PAGE_SIZE) {
+        if ((page = mem_page(pa + i)) == NULL)
+            return;
+        page->vaddr_mapped = va ? va + i : pa + i;
+    }
+}
+
+// Unmap everything in an area, freeing the pages vmalloc put there
+static void vm_area_unmap(vm_area_t * area) {
+    uintptr_t va, pa;
+    uint32_t size, i;
+
+    for (va = area->addr; va < area->addr + area->length; va += size) {
+        if (mmu_lookup(va, &pa, &size) != 0) {
+            size = PAGE_SIZE;
+            continue;
+        }
+        mmu_unmap(va, size);
+        vm_count_mapping(size, -1);
+        vm_set_vaddr(pa, size, 0);
+        if (area->flags & VM_LAZY)
+            for (i = 0; i < size; i += PAGE_SIZE)
+                free_page((void *)(pa + i));
+    }
+}
+
+void * kmap(uintptr_t phys, uint32_t size, uint32_t flags) {
+    uintptr_t pa = phys & ~(PAGE_SIZE - 1), va;
+    uint32_t length, align, step;
+    vm_area_t * area;
+    uintptr_t irq;
+
+    if (size == 0)
+        return NULL;
+    if (!vm_on)
+        return (void *)phys;
+    length = ALIGN_UP(phys + size, PAGE_SIZE) - pa;
+
+    // Put the area as far into the alignment as pa is, so the big pieces line up on both sides
+    align = vm_mapping_size(0, 0, length, flags);
+    irq = spin_lock_irqsave(&vm_lock);
+    if ((area = vm_area_new(length, align, align > PAGE_SIZE ? pa % align : 0, flags)) == NULL) {
+        spin_unlock_irqrestore(&vm_lock, irq);
+        printk(LOG_WARN, "kmap: no room for %u bytes", length);
+        return NULL;
+    }
+    area->phys = pa;
+    for (va = area->addr; va < area->addr + length; va += step, pa += step) {
+        step = vm_mapping_size(va, pa, area->addr + length - va, flags);
+        if (mmu_map(va, pa, step, vm_memory_type(flags)) != 0) {
+            // Only runs out of memory for a second level table
+            vm_area_unmap(area);
+            vm_area_delete(area);
+            spin_unlock_irqrestore(&vm_lock, irq);
+            printk(LOG_WARN, "kmap: out of page table memory");
+            return NULL;
+        }
+        vm_count_mapping(step, 1);
+        vm_set_vaddr(pa, step, va);
+    }
+    va = area->addr + phys % PAGE_SIZE;
+    spin_unlock_irqrestore(&vm_lock, irq);
+    return (void *)va;
+}
+
+void kunmap(void * addr) {
+    vm_area_t * area;
+    uintptr_t irq;
+
+    if (!vm_on)
+        return;
+    irq = spin_lock_irqsave(&vm_lock);
+    if ((area = vm_area_find((uintptr_t)addr)) != NULL && !(area->flags & VM_LAZY)) {
+        vm_area_unmap(area);
+        vm_area_delete(area);
+    }
+    spin_unlock_irqrestore(&vm_lock, irq);
+}
+
+void * vmalloc(uint32_t size, uint32_t flags) {
+    uint32_t length = ALIGN_UP(size, PAGE_SIZE);
+    vm_area_t * area;
+    void * pages;
+    uintptr_t irq;
+
+    if (size == 0)
+        return NULL;
+    flags &= VM_NO_SECTIONS | VM_SMALL_PAGES;
+
+    if (!vm_on) {
+        // Only the bookkeeping, so vfree knows how many pages to give back
+        if ((pages = alloc_pages(length / PAGE_SIZE)) == NULL)
+            return NULL;
+        if ((area = kmalloc(sizeof(vm_area_t))) == NULL) {
+            for (; length > 0; length -= PAGE_SIZE)
+                free_page((uint8_t *)pages + length - PAGE_SIZE);
+            return NULL;
+        }
+        area->addr = (uintptr_t)pages;
+        area->length = length;
+        area->phys = (uintptr_t)pages;
+        area->flags = flags | VM_DIRECT;
+        irq = spin_lock_irqsave(&vm_lock);
+        append_vm_area_list(&vm_areas, area);
+        vm_stats.areas++;
+        spin_unlock_irqrestore(&vm_lock, irq);
+        return pages;
+    }
+
+    irq = spin_lock_irqsave(&vm_lock);
+    area = vm_area_new(length, vm_mapping_size(0, 0, length, flags), 0, flags | VM_LAZY);
+    spin_unlock_irqrestore(&vm_lock, irq);
+    if (area == NULL) {
+        printk(LOG_WARN, "vmalloc: no room for %u bytes", length);
+        return NULL;
+    }
+    return (void *)area->addr;
+}
+
+void vfree(void * addr) {
+    vm_area_t * area;
+    uint32_t i;
+    uintptr_t irq;
+
+    irq = spin_lock_irqsave(&vm_lock);
+    if ((area = vm_area_find((uintptr_t)addr)) == NULL || !(area->flags & (VM_LAZY | VM_DIRECT))) {
+        spin_unlock_irqrestore(&vm_lock, irq);
+        return;
+    }
+    if (area->flags & VM_DIRECT) {
+        remove_vm_area_list(&vm_areas, area);
+        vm_stats.areas--;
+        spin_unlock_irqrestore(&vm_lock, irq);
+        for (i = 0; i < area->length; i += PAGE_SIZE)
+            free_page((void *)(area->phys + i));
+        kfree(area);
+        return;
+    }
+    vm_area_unmap(area);
+    vm_area_delete(area);
+    spin_unlock_irqrestore(&vm_lock, irq);
+}
+
+int vm_fault(uintptr_t addr) {
+    static const uint32_t sizes[] = { SECTION_SIZE, LARGE_PAGE_SIZE, PAGE_SIZE };
+    vm_area_t * area;
+    uintptr_t block, irq;
+    uint32_t i, size;
+    void * pages;
+
+    irq = spin_lock_irqsave(&vm_lock);
+    if ((area = vm_area_find(addr)) == NULL || !(area->flags & VM_LAZY)) {
+        spin_unlock_irqrestore(&vm_lock, irq);
+        return -1;
+    }
+
+    // The biggest piece around addr that the area covers, isn't partly mapped already and has
+    // aligned memory free to back it
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size = sizes[i];
+        block = addr & ~(uintptr_t)(size - 1);
+        if (block < area->addr || !mmu_range_free(block, size) ||
+                vm_mapping_size(block, 0, area->addr + area->length - block, area->flags) < size)
+            continue;
+        if ((pages = alloc_pages_aligned(size / PAGE_SIZE, size / PAGE_SIZE)) == NULL)
+            continue;
+        if (mmu_map(block, (uintptr_t)pages, size, MMU_NORMAL) != 0) {
+            for (; size > 0; size -= PAGE_SIZE)
+                free_page((uint8_t *)pages + size - PAGE_SIZE);
+            continue;
+        }
+        vm_count_mapping(size, 1);
+        vm_set_vaddr((uintptr_t)pages, size, block);
+        vm_stats.faults++;
+        spin_unlock_irqrestore(&vm_lock, irq);
+        return 0;
+    }
+    spin_unlock_irqrestore(&vm_lock, irq);
+    printk(LOG_ERR, "vm_fault: out of memory at %x", (unsigned int)addr);
+    return -1;
+}
+
+uintptr_t virt_to_phys(const void * addr) {
+    uintptr_t pa;
+    uint32_t size;
+
+    if (!vm_on || mmu_lookup((uintptr_t)addr, &pa, &size) != 0)
+        return (uintptr_t)addr;
+    return pa;
+}
+
+void * phys_to_virt(uintptr_t phys) {
+    page_t * page = mem_page(phys);
+
+    if (page == NULL)
+        return (void *)phys;
+    return (void *)((uintptr_t)page->vaddr_mapped + phys % PAGE_SIZE);
+}
+
+int vm_user_access(const void * addr, uint32_t size, mmu_user_access_t access) {
+    uintptr_t irq;
+    int res;
+
+    if (!vm_on)
+        return 0;
+    irq = spin_lock_irqsave(&vm_lock);
+    res = mmu_set_user_access((uintptr_t)addr, size, access);
+    spin_unlock_irqrestore(&vm_lock, irq);
+    return res;
+}
+
+int asid_alloc(void) {
+    uint32_t i;
+    uintptr_t irq;
+
+    irq = spin_lock_irqsave(&vm_lock);
+    for (i = 1; i < MMU_NUM_ASIDS; i++) {
+        if (!(asid_bitmap[i / 32] & (1 << (i % 32)))) {
+            asid_bitmap[i / 32] |= 1 << (i % 32);
+            spin_unlock_irqrestore(&vm_lock, irq);
+            return i;
+        }
+    }
+    spin_unlock_irqrestore(&vm_lock, irq);
+    return -1;
+}
+
+void asid_free(uint32_t asid) {
+    uintptr_t irq;
+
+    if (asid == 0 || asid >= MMU_NUM_ASIDS)
+        return;
+    // Nothing tagged with it may survive into its next user
+    tlb_flush_asid(asid);
+    irq = spin_lock_irqsave(&vm_lock);
+    asid_bitmap[asid / 32] &= ~(1 << (asid % 32));
+    spin_unlock_irqrestore(&vm_lock, irq);
+}
+
+void vm_get_stats(vm_stats_t * stats) {
+    *stats = vm_stats;
+}
@@ -0,0 +1,126 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <common/stdio.h>
+#include <common/string.h>
+#include <user/programs.h>
+#include <user/ulib.h>
+
+// Say hello, with some heap and the uptime from the shared page
+static int hello_main(uintptr_t arg, const vdso_page_t * vdso) {
+    static const char greeting[] = "Hello from task ";
+    vdso_page_t now;
+    char * buf;
+    size_t i;
+
+    (void) arg;
+    buf = sys_sbrk(sizeof(greeting));
+    if (buf == (char *)-1)
+        return 1;
+    for (i = 0; i < sizeof(greeting); i++)
+        buf[i] = greeting[i];
+    uputs(buf);
+    uput_uint(sys_getpid());
+    vdso_read(vdso, &now);
+    uputs(", up for ");
+    uput_uint(now.ticks * now.tick_ms);
+    uputs(" ms with ");
+    uput_uint(now.tasks);
+    uputs(" tasks\n");
+    return 0;
+}
+
+// Take turns with the other tasks for arg rounds
+static int pingpong_main(uintptr_t arg, const vdso_page_t * vdso) {
+    uint32_t id = sys_getpid(), rounds = arg ? arg : 5, i;
+
+    (void) vdso;
+    for (i = 0; i < rounds; i++) {
+        uputs("[");
+        uput_uint(id);
+        uputs("] round ");
+        uput_uint(i + 1);
+        uputs("\n");
+        sys_yield();
+    }
+    return 0;
+}
+
+// Send back what is typed until a q
+static int echo_main(uintptr_t arg, const vdso_page_t * vdso) {
+    char buf[32];
+    intptr_t len, i;
+
+    (void) arg;
+    (void) vdso;
+    uputs("Type away, q to stop\n");
+    while ((len = sys_read(0, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < len; i++) {
+            if (buf[i] == 'q') {
+                uputs("\n");
+                return 0;
+            }
+            sys_write(1, &buf[i], 1);
+            if (buf[i] == '\r')
+                uputs("\n");
+        }
+    }
+    return 1;
+}
+
+int sysbench_main(uintptr_t op, const vdso_page_t * vdso) {
+    vdso_page_t now;
+    uint32_t i;
+
+    for (i = 0; i < SYSBENCH_ITERATIONS; i++) {
+        switch (op) {
+        case SYSBENCH_GETPID:
+            sys_getpid();
+            break;
+        case SYSBENCH_TIME:
+            sys_time();
+            break;
+        case SYSBENCH_WRITE:
+            sys_write(1, NULL, 0);
+            break;
+        case SYSBENCH_YIELD:
+            sys_yield();
+            break;
+        case SYSBENCH_VDSO:
+            vdso_read(vdso, &now);
+            break;
+        default:
+            // Keep the empty loop from being optimized away
+            asm volatile("" ::: "memory");
+            break;
+        }
+    }
+    return 0;
+}
+
+static const user_program_t user_programs[] = {
+    { "hello", hello_main, "hello" },
+    { "pingpong", pingpong_main, "pingpong [rounds]" },
+    { "echo", echo_main, "echo" },
+    { "sysbench", sysbench_main, "sysbench <op>, see bench syscalls" },
+};
+
+#define NUM_USER_PROGRAMS (sizeof(user_programs) / sizeof(user_programs[0]))
+
+const user_program_t * user_program_find(const char * name) {
+    uint32_t i;
+
+    for (i = 0; i < NUM_USER_PROGRAMS; i++)
+        if (strcmp(name, user_programs[i].name) == 0)
+            return &user_programs[i];
+    return NULL;
+}
+
+void user_program_list(void) {
+    uint32_t i;
+
+    for (i = 0; i < NUM_USER_PROGRAMS; i++) {
+        puts("  ");
+        puts(user_programs[i].usage);
+        putc('\n');
+    }
+}
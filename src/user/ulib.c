@@ -0,0 +1,40 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <kernel/atomic.h>
+#include <user/ulib.h>
+
+void sys_exit(int code) {
+    syscall3(SYS_EXIT, code, 0, 0);
+    while (1);
+}
+
+void uputs(const char * s) {
+    size_t len = 0;
+
+    while (s[len])
+        len++;
+    sys_write(1, s, len);
+}
+
+void uput_uint(uint32_t value) {
+    char buf[10];
+    int i = sizeof(buf);
+
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    sys_write(1, buf + i, sizeof(buf) - i);
+}
+
+void vdso_read(const vdso_page_t * vdso, vdso_page_t * copy) {
+    uint32_t seq;
+
+    // Retry until the kernel wasn't half way through an update while we copied
+    do {
+        while ((seq = vdso->seq) & 1);
+        dmb();
+        *copy = *vdso;
+        dmb();
+    } while (vdso->seq != seq);
+}
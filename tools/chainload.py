@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""Send a kernel image or a data blob to the `chainload` shell command over a serial line.
+
+Works on a real serial port or a qemu pty, and types the command itself unless told not to:
+
+    make run SERIAL=pty                                                   # qemu prints the pty it made
+    tools/chainload.py /dev/pts/3 build/kernel.img                       # load at 0x8000 and start it
+    tools/chainload.py /dev/ttyUSB0 data.bin --blob --load-addr 0x800000 --baud 921600
+
+The protocol is described in include/kernel/chainload.h.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+import zlib
+
+FRAME_SIZE = 1024
+WINDOW = 8
+NO_ENTRY = 0xFFFFFFFF
+ACK = 0x06
+NAK = 0x15
+BAD_BAUD = 4
+
+# Keep in sync with chainload_status_t in include/kernel/chainload.h
+STATUS = [
+    "ok",
+    "bad header",
+    "image too big",
+    "bad load address",
+    "unsupported baud rate",
+    "out of memory",
+    "image CRC mismatch",
+    "timeout",
+]
+
+
+class Serial:
+    def __init__(self, path, baud):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        self.buf = b""
+        self.set_baud(baud)
+
+    def set_baud(self, baud):
+        speed = getattr(termios, "B%d" % baud, None)
+        if speed is None:
+            sys.exit("baud rate %d isn't supported by this host" % baud)
+        attrs = termios.tcgetattr(self.fd)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSADRAIN, attrs)
+
+    def write(self, data):
+        while data:
+            data = data[os.write(self.fd, data):]
+
+    def read(self, n, timeout):
+        """Up to n bytes, waiting at most timeout seconds for the first."""
+        if not self.buf:
+            ready, _, _ = select.select([self.fd], [], [], timeout)
+            if ready:
+                self.buf = os.read(self.fd, 65536)
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def expect(self, magic, timeout, echo=False):
+        """Wait for magic, optionally echoing what comes before it."""
+        seen = b""
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            byte = self.read(1, deadline - time.time())
+            if not byte:
+                continue
+            seen = (seen + byte)[-len(magic):]
+            if echo and byte not in magic:
+                sys.stdout.write(byte.decode("ascii", "replace"))
+            if seen == magic:
+                return True
+        return False
+
+    def status(self, magic, timeout):
+        if not self.expect(magic, timeout):
+            sys.exit("no %s from the kernel" % magic.decode())
+        data = b""
+        while len(data) < 4:
+            more = self.read(4 - len(data), timeout)
+            if not more:
+                sys.exit("truncated %s from the kernel" % magic.decode())
+            data += more
+        return struct.unpack("<I", data)[0]
+
+
+def frame(seq, payload):
+    head = struct.pack("<HH", seq & 0xFFFF, len(payload))
+    return b"\x01" + head + payload + struct.pack("<I", zlib.crc32(head + payload))
+
+
+def send_frames(port, image):
+    """Go-back-N: keep WINDOW frames in flight, rewind to whatever the kernel NAKs."""
+    frames = [image[i:i + FRAME_SIZE] for i in range(0, len(image), FRAME_SIZE)]
+    base = 0        # oldest unacknowledged frame
+    next_seq = 0
+    pending = b""
+    resends = 0
+    while base < len(frames):
+        while next_seq < len(frames) and next_seq < base + WINDOW:
+            port.write(frame(next_seq, frames[next_seq]))
+            next_seq += 1
+        pending += port.read(64, 2.0)
+        if not pending:
+            sys.exit("\nthe kernel stopped answering at frame %d" % base)
+        while len(pending) >= 3 and base < len(frames):
+            kind, seq = pending[0], struct.unpack_from("<H", pending, 1)[0]
+            if kind not in (ACK, NAK):
+                pending = pending[1:]
+                continue
+            pending = pending[3:]
+            # Sequence numbers are 16 bits, put them back next to base
+            seq = base + ((seq - base + 0x8000) & 0xFFFF) - 0x8000
+            if kind == ACK and seq >= base:
+                base = seq + 1
+            elif kind == NAK and base <= seq < next_seq:
+                base = next_seq = seq
+                resends += 1
+        sys.stdout.write("\r%d/%d frames" % (base, len(frames)))
+        sys.stdout.flush()
+    # The status can come in the same read as the last ACK
+    port.buf = pending + port.buf
+    print()
+    return resends
+
+
+def sync(port, baud):
+    """Switch to baud and wait for the kernel to answer there."""
+    port.set_baud(baud)
+    deadline = time.time() + 3
+    while not port.expect(b"RCLS", 0.05):
+        if time.time() > deadline:
+            return False
+        port.write(b"RCLS")
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("device", help="serial device or qemu pty")
+    parser.add_argument("file", help="kernel image (.img, not .elf) or data to send")
+    parser.add_argument("--load-addr", type=lambda s: int(s, 0), default=0x8000,
+                        help="where the image goes (default 0x8000, 0x80000 for kernel8.img)")
+    parser.add_argument("--entry", type=lambda s: int(s, 0), help="where to start it (default the load address)")
+    parser.add_argument("--blob", action="store_true", help="just load the data, don't start it")
+    parser.add_argument("--baud", type=int, default=921600,
+                        help="rate for the transfer, 0 to keep the current one (the default if the kernel can't do it)")
+    parser.add_argument("--initial-baud", type=int, default=115200, help="rate the shell is running at")
+    parser.add_argument("--no-command", action="store_true", help="don't type `chainload`, it's already running")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        image = f.read()
+    entry = NO_ENTRY if args.blob else (args.load_addr if args.entry is None else args.entry)
+    baud = 0 if args.baud == args.initial_baud else args.baud
+
+    port = Serial(args.device, args.initial_baud)
+    if not args.no_command:
+        port.write(b"chainload\r")
+    while True:
+        if not port.expect(b"RCL1", 30, echo=True):
+            sys.exit("the kernel never asked for an image")
+
+        header = struct.pack("<4sIIIII", b"RCLH", len(image), args.load_addr, entry, baud, zlib.crc32(image))
+        port.write(header + struct.pack("<I", zlib.crc32(header)))
+        status = port.status(b"RCLA", 2.0)
+        if status == BAD_BAUD and baud:
+            # qemu's UART clock stops at 187500 baud, and so does older firmware's
+            print("kernel can't do %d baud, sending at %d" % (baud, args.initial_baud))
+            baud = 0
+            port.write(b"chainload\r")
+            continue
+        if status:
+            sys.exit("kernel refused the image: %s" % STATUS[status])
+        if not baud or sync(port, baud):
+            break
+        # The kernel gives up too, goes back to the old rate and says so
+        port.set_baud(args.initial_baud)
+        port.status(b"RCLD", 5.0)
+        print("kernel didn't come up at %d baud, sending at %d" % (baud, args.initial_baud))
+        baud = 0
+        port.write(b"chainload\r")
+
+    start = time.time()
+    resends = send_frames(port, image)
+    status = port.status(b"RCLD", 5.0)
+    elapsed = time.time() - start
+    port.set_baud(args.initial_baud)
+
+    print("%d bytes in %.2f s, %.1f KB/s at %d baud, %d resends" %
+          (len(image), elapsed, len(image) / elapsed / 1024, baud or args.initial_baud, resends))
+    if status:
+        sys.exit("transfer failed: %s" % STATUS[status])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Decode a `tracedump` from the kernel into a timeline.
+
+The input is anything that contains the dump: a capture of the serial output, or the
+serial device / qemu pty itself, in which case it is read until the dump ends:
+
+    qemu ... -serial pty                  # then type `tracedump` in the shell
+    tools/tracedecode.py /dev/pts/3
+
+    tools/tracedecode.py capture.bin --cpu 0 --event kmalloc
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"RTRC"
+TRAILER = b"RTRE"
+
+# Keep in sync with trace_event_t in include/kernel/trace.h
+EVENTS = {
+    1: "kmalloc",
+    2: "kfree",
+    3: "alloc_page",
+    4: "free_page",
+    5: "uart_putc",
+    6: "uart_getc",
+    7: "uart_write",
+    8: "shell_command",
+}
+
+
+def read_dump(path):
+    """Return the bytes from the header magic to the trailer."""
+    data = b""
+    with open(path, "rb", buffering=0) as f:
+        while True:
+            chunk = f.read(65536)
+            if not chunk:
+                break
+            data += chunk
+            start = data.find(MAGIC)
+            if start >= 0 and dump_complete(data[start:]):
+                break
+    start = data.find(MAGIC)
+    if start < 0:
+        sys.exit("no trace dump found in %s" % path)
+    return data[start:]
+
+
+def dump_complete(dump):
+    """True once the whole dump, trailer included, is in the buffer."""
+    try:
+        _, _, rest = parse(dump)
+    except (struct.error, ValueError):
+        return False
+    return rest[:4] == TRAILER
+
+
+def parse(dump):
+    """Split a dump into (cycle counter hz, {cpu: [records]}, remaining bytes)."""
+    version, record_size, num_cpus, hz = struct.unpack_from("<4xHHII", dump, 0)
+    if version != 1 or record_size != 16:
+        raise ValueError("unsupported dump version %d, record size %d" % (version, record_size))
+    pos = 16
+    cpus = {}
+    for _ in range(num_cpus):
+        cpu, count = struct.unpack_from("<II", dump, pos)
+        pos += 8
+        if pos + count * record_size > len(dump):
+            raise struct.error("truncated")
+        cpus[cpu] = [struct.unpack_from("<IHHII", dump, pos + i * record_size) for i in range(count)]
+        pos += count * record_size
+    return hz, cpus, dump[pos:]
+
+
+def unwrap(records):
+    """The counter is 32 bits, turn its timestamps into a monotonic 64 bit count."""
+    out = []
+    high = 0
+    last = None
+    for ts, event, cpu, arg0, arg1 in records:
+        if last is not None and ts < last:
+            high += 1 << 32
+        last = ts
+        out.append((high + ts, event, cpu, arg0, arg1))
+    return out
+
+
+def describe(event, arg0, arg1):
+    name = EVENTS.get(event, "event%d" % event)
+    if event == 1:
+        return name, "%d bytes -> 0x%08x" % (arg0, arg1)
+    if event in (2, 3, 4):
+        return name, "0x%08x" % arg0
+    if event in (5, 6):
+        return name, repr(chr(arg0))
+    if event == 7:
+        return name, "%d bytes" % arg0
+    if event == 8:
+        text = struct.pack("<I", arg0).rstrip(b"\0").decode("ascii", "replace")
+        if arg1 > 4:
+            text += "..."
+        return name, "%s (%d chars)" % (text, arg1)
+    return name, "0x%08x 0x%08x" % (arg0, arg1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="capture file or serial device")
+    parser.add_argument("--hz", type=int, help="cycle counter frequency, overrides the one in the dump")
+    parser.add_argument("--cpu", type=int, help="only show this cpu")
+    parser.add_argument("--event", help="only show this event")
+    args = parser.parse_args()
+
+    hz, cpus, _ = parse(read_dump(args.input))
+    hz = args.hz or hz or 1
+
+    timeline = []
+    for cpu, records in cpus.items():
+        if args.cpu is None or cpu == args.cpu:
+            timeline.extend(unwrap(records))
+    timeline.sort()
+    if not timeline:
+        print("no events recorded")
+        return
+
+    start = timeline[0][0]
+    counts = {}
+    print("%12s  %3s  %-14s %s" % ("time (us)", "cpu", "event", "details"))
+    for ts, event, cpu, arg0, arg1 in timeline:
+        name, details = describe(event, arg0, arg1)
+        counts[name] = counts.get(name, 0) + 1
+        if args.event and name != args.event:
+            continue
+        print("%12.3f  %3d  %-14s %s" % ((ts - start) * 1e6 / hz, cpu, name, details))
+
+    span = (timeline[-1][0] - start) * 1e6 / hz
+    print("\n%d events over %.3f us at %d Hz" % (len(timeline), span, hz))
+    for name in sorted(counts):
+        print("  %-14s %d" % (name, counts[name]))
+
+
+if __name__ == "__main__":
+    main()